@@ -0,0 +1,322 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+
+/*
+    Batch fingerprinting on a small work-stealing pool.
+
+    Every worker starts with an even share of the songs,
+    takes them from the front, and when it runs out takes
+    the back half of the share of another worker. Workers
+    keep their handle between songs and batches, and
+    fp_reset it for the next song.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "thread.h"
+
+/*
+    more would only make the shares smaller
+*/
+#define MAX_WORKERS     256
+
+typedef struct
+{
+    /*
+        songs next to end - 1 are still to do,
+        they can be taken by other workers
+    */
+    t_mutex lock;
+    int next;
+    int end;
+
+    /*
+        kept from song to song
+    */
+    t_fooid *fid;
+
+    struct t_fp_batch *batch;
+    int index;
+    int failed;
+}
+t_worker;
+
+struct t_fp_batch
+{
+    int threads;
+    t_worker *workers;
+    fp_batch_item *items;
+};
+
+FOOIDAPI t_fp_batch * fp_batch_init(int threads)
+{
+    t_fp_batch *batch;
+    int i;
+
+    if (threads < 1) {
+        return NULL;
+    }
+    if (threads > MAX_WORKERS) {
+        threads = MAX_WORKERS;
+    }
+
+    batch = (t_fp_batch *)mem_alloc(NULL, sizeof(t_fp_batch));
+
+    if (batch == NULL) {
+        return NULL;
+    }
+
+    batch->workers = (t_worker *)mem_calloc(NULL, threads, sizeof(t_worker));
+
+    if (batch->workers == NULL) {
+        mem_free(NULL, batch);
+        return NULL;
+    }
+
+    batch->threads = threads;
+    batch->items = NULL;
+
+    for (i = 0; i < threads; i++) {
+        mutex_init(&(batch->workers[i].lock));
+        batch->workers[i].fid = NULL;
+        batch->workers[i].batch = batch;
+        batch->workers[i].index = i;
+    }
+
+    return batch;
+}
+
+FOOIDAPI void fp_batch_free(t_fp_batch *batch)
+{
+    int i;
+
+    if (batch == NULL) {
+        return;
+    }
+
+    for (i = 0; i < batch->threads; i++) {
+        if (batch->workers[i].fid != NULL) {
+            fp_free(batch->workers[i].fid);
+        }
+        mutex_destroy(&(batch->workers[i].lock));
+    }
+
+    mem_free(NULL, batch->workers);
+    mem_free(NULL, batch);
+}
+
+/*
+    get a handle for the song, the worker's own one
+    if it can be reset, a new one otherwise
+
+    output * handle, NULL on error
+*/
+static t_fooid* worker_handle(t_worker *w, const fp_batch_item *item)
+{
+    if (w->fid != NULL) {
+        if (fp_reset(w->fid, item->samplerate, item->channels) == 0) {
+            return w->fid;
+        }
+        fp_free(w->fid);
+    }
+
+    w->fid = fp_init(item->samplerate, item->channels);
+
+    return w->fid;
+}
+
+/*
+    fingerprint one song
+
+    output *   0 on success
+             < 0 on error
+*/
+static int process_item(t_worker *w, fp_batch_item *item)
+{
+    t_fooid *fid;
+    int songlen;
+
+    if (item->samplerate <= 0 || item->channels <= 0) {
+        return -1;
+    }
+
+    fid = worker_handle(w, item);
+
+    if (fid == NULL) {
+        return -1;
+    }
+
+    if (item->feeder != NULL) {
+        songlen = item->feeder(item->user, fid);
+    } else {
+        if (item->shorts != NULL) {
+            if (fp_feed_short(fid, item->shorts, item->size) < 0) {
+                return -1;
+            }
+        } else if (item->floats != NULL) {
+            if (fp_feed_float(fid, item->floats, item->size) < 0) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+
+        songlen = (int)(((double)item->size / item->channels) * 100.0 / item->samplerate);
+    }
+
+    if (songlen < 0) {
+        return -1;
+    }
+
+    if (item->songlen > 0) {
+        songlen = item->songlen;
+    }
+
+    return fp_calculate(fid, songlen, item->fingerprint);
+}
+
+/*
+    next song for a worker, its own first,
+    then half of what another one has left
+
+    output * song index, < 0 when all are taken
+*/
+static int next_item(t_worker *w)
+{
+    t_fp_batch *batch = w->batch;
+    t_worker *v;
+    int item = -1;
+    int i, mid;
+    int end = 0;
+
+    mutex_lock(&(w->lock));
+    if (w->next < w->end) {
+        item = w->next++;
+    }
+    mutex_unlock(&(w->lock));
+
+    if (item >= 0) {
+        return item;
+    }
+
+    /*
+        only one lock is held at a time, the stolen
+        songs are out of sight until we publish them,
+        which is fine as we are the one to do them
+    */
+    for (i = 1; i < batch->threads && item < 0; i++) {
+        v = &(batch->workers[(w->index + i) % batch->threads]);
+
+        mutex_lock(&(v->lock));
+        if (v->next < v->end) {
+            mid = v->end - (v->end - v->next + 1) / 2;
+            end = v->end;
+            v->end = mid;
+            item = mid;
+        }
+        mutex_unlock(&(v->lock));
+    }
+
+    if (item >= 0) {
+        mutex_lock(&(w->lock));
+        w->next = item + 1;
+        w->end = end;
+        mutex_unlock(&(w->lock));
+    }
+
+    return item;
+}
+
+static void run_worker(t_worker *w)
+{
+    fp_batch_item *item;
+    int i;
+
+    while ((i = next_item(w)) >= 0) {
+        item = &(w->batch->items[i]);
+        item->result = process_item(w, item);
+
+        if (item->result < 0) {
+            w->failed++;
+        }
+    }
+}
+
+static THREAD_PROC(worker_thread, arg)
+{
+    run_worker((t_worker *)arg);
+
+    THREAD_RETURN;
+}
+
+FOOIDAPI int fp_batch_run(t_fp_batch *batch, fp_batch_item *items, int count)
+{
+    t_thread threads[MAX_WORKERS];
+    int started[MAX_WORKERS];
+    int failed = 0;
+    int workers;
+    int i;
+
+    if (batch == NULL || count < 0 || (count > 0 && items == NULL)) {
+        return -1;
+    }
+
+    workers = batch->threads;
+    if (workers > count) {
+        workers = count;
+    }
+
+    batch->items = items;
+
+    /*
+        even shares to start with, workers that
+        don't get a thread have theirs taken over
+    */
+    for (i = 0; i < batch->threads; i++) {
+        t_worker *w = &(batch->workers[i]);
+
+        w->failed = 0;
+        if (i < workers) {
+            w->next = (int)(((long long)count * i) / workers);
+            w->end  = (int)(((long long)count * (i + 1)) / workers);
+        } else {
+            w->next = 0;
+            w->end = 0;
+        }
+    }
+
+    for (i = 1; i < workers; i++) {
+        started[i] = thread_start(&threads[i], worker_thread, &(batch->workers[i]));
+    }
+
+    run_worker(&(batch->workers[0]));
+
+    for (i = 1; i < workers; i++) {
+        if (started[i]) {
+            thread_join(threads[i]);
+        }
+    }
+
+    for (i = 0; i < batch->threads; i++) {
+        failed += batch->workers[i].failed;
+    }
+
+    batch->items = NULL;
+
+    return failed;
+}
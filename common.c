@@ -14,6 +14,8 @@
     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 */
 
+#include <stdlib.h>
+#include <string.h>
 #include "common.h"
 
 const int bitlen(int n)
@@ -28,6 +30,116 @@ const int bitlen(int n)
     return res;
 }
 
+void mem_set_allocator(fp_allocator *mem, const fp_allocator *allocator)
+{
+    if (allocator == NULL || allocator->alloc == NULL || allocator->release == NULL) {
+        mem->alloc = NULL;
+        mem->release = NULL;
+        mem->aligned_alloc = NULL;
+        mem->ctx = NULL;
+    } else {
+        *mem = *allocator;
+    }
+}
+
+void* mem_alloc(const fp_allocator *mem, size_t size)
+{
+    if (mem != NULL && mem->alloc != NULL) {
+        return mem->alloc(mem->ctx, size);
+    }
+
+    return malloc(size);
+}
+
+void* mem_calloc(const fp_allocator *mem, size_t count, size_t size)
+{
+    void *ptr;
+
+    if (size != 0 && count > (size_t)-1 / size) {
+        return NULL;
+    }
+
+    ptr = mem_alloc(mem, count * size);
+    if (ptr != NULL) {
+        memset(ptr, 0, count * size);
+    }
+
+    return ptr;
+}
+
+void mem_free(const fp_allocator *mem, void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    if (mem != NULL && mem->release != NULL) {
+        mem->release(mem->ctx, ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+/*
+    align a block from an unaligned allocator,
+    the original pointer is kept just before
+    the aligned one
+*/
+static void* align_block(void *raw)
+{
+    size_t addr;
+    void **ptr;
+
+    if (raw == NULL) {
+        return NULL;
+    }
+
+    addr = ((size_t)raw + sizeof(void*) + MEM_ALIGN - 1) & ~(size_t)(MEM_ALIGN - 1);
+    ptr = (void**)addr;
+    ptr[-1] = raw;
+
+    return ptr;
+}
+
+static void* unalign_block(void *ptr)
+{
+    return ((void**)ptr)[-1];
+}
+
+void* mem_alloc_aligned(const fp_allocator *mem, size_t size)
+{
+    if (mem != NULL && mem->aligned_alloc != NULL) {
+        return mem->aligned_alloc(mem->ctx, size, MEM_ALIGN);
+    }
+
+    return align_block(mem_alloc(mem, size + MEM_ALIGN + sizeof(void*)));
+}
+
+void mem_free_aligned(const fp_allocator *mem, void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    if (mem != NULL && mem->aligned_alloc != NULL) {
+        mem_free(mem, ptr);
+    } else {
+        mem_free(mem, unalign_block(ptr));
+    }
+}
+
+void* table_alloc(size_t size)
+{
+    return align_block(malloc(size + MEM_ALIGN + sizeof(void*)));
+}
+
+void table_free(void *ptr)
+{
+    if (ptr != NULL) {
+        free(unalign_block(ptr));
+    }
+}
+
 #if defined(SLOWROUND) || defined(WIN64)
 const int round(const float x) {
     assert(x >= INT_MIN-0.5);
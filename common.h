@@ -17,7 +17,10 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include "prefix.h"
 #include "fooid.h"
+#include "s_fft.h"
+#include "polyphase.h"
 
 /*
     defines
@@ -36,9 +39,10 @@
 #define MAX_BARK                   17
 
 /*
-    size of total analysis sample data
+    number of frames of analysis data
+    (90 seconds worth)
 */
-#define SSIZE       (8000 * 100)
+#define ANFRAMES    ((8000 * 90) / FRAME_LEN)
 
 /*
     number of samples of input to resample per time
@@ -46,10 +50,13 @@
 #define IN_LEN        2048
 
 /*
-    fingerprint (version 0)
+    fingerprint version 1, or version 0 for handles
+    set up to make them the way earlier versions did,
+    which also gives the same bytes as those
 */
-#define FPVERSION        0
-#define FPSIZE         424
+#define FPVERSION        1
+#define FPVERSION_EXACT  0
+#define FPSIZE         FP_SIZE
 
 /*
     fingerprint storage
@@ -84,17 +91,62 @@ struct t_fingerprint
 };
 
 /*
-    processing storage
+    the band regression sweeps 4 bands side by side,
+    in phases during which no lane changes band
 */
-struct t_fooid
+#define SWEEP_LANES         4
+#define SWEEP_PHASES MAX_BARK
+
+typedef struct
+{
+    /*  number of lines */
+    int len;
+    /*  first line and its x in the band, per lane */
+    int pos[SWEEP_LANES];
+    float x[SWEEP_LANES];
+    /*  band that is complete after this phase, or -1 */
+    int band[SWEEP_LANES];
+}
+t_sweep_phase;
+
+/*
+    spectral analysis tables, the same
+    for every handle and shared by all
+*/
+typedef struct
 {
-    /*  spectral stuff */
     float window[SPEC_LEN];
-    int line_to_cb[SPEC_LEN];
     int cb_start[MAX_BARK];
     int cb_size[MAX_BARK];
     int max_sfb;
 
+    /*  x statistics of the regression per band */
+    float lenavx[MAX_BARK];
+    float ssxx[MAX_BARK];
+    t_sweep_phase phases[SWEEP_PHASES];
+    int nphases;
+
+    /*  quantized dominant harmonic per spectral line */
+    unsigned char dom_code[SPEC_LEN];
+}
+t_frame_tables;
+
+/*
+    processing storage
+*/
+struct t_fooid
+{
+    /*  memory of the handle and its resampler */
+    fp_allocator allocator;
+
+    /*  spectral stuff */
+    const t_frame_tables *tables;
+    int exact_log;
+
+    /*  FFT stuff, tables are shared, work buffer is ours */
+    const t_fft_data *fft_data;
+    t_complex *fft_work;
+
     /*  settings stuff */
     int channels;
     int samplerate;
@@ -103,21 +155,60 @@ struct t_fooid
     float *samples;
     float *sbuffer;
     int soundfound;
+    int framepos;
+
+    /* per frame results so far */
+    int frames;
+    int analysed;
+    int counts[4];
+    int doms[88];
+    int total_dom;
+
+    /* parallel analysis, frames are kept until fp_calculate */
+    int threads;
+    fp_executor_func executor;
+    void *executor_ctx;
+    float *frame_store;
+    t_complex *thread_work;
 
     /* resampling stuff */
     float resample_ratio;
     void *resample_h;
+    t_polyphase *poly;
     int outpos;
 
     /* actual fingerprint */
     struct t_fingerprint fp;
 };
 
+/*
+    alignment of sample and FFT buffers
+*/
+#define MEM_ALIGN       64
+
 /*
     functions
 */
 const int bitlen(int n);
 
+/*
+    per handle memory, goes through the handle's
+    allocator, NULL or no hooks means malloc and free
+*/
+void mem_set_allocator(fp_allocator *mem, const fp_allocator *allocator);
+void* mem_alloc(const fp_allocator *mem, size_t size);
+void* mem_calloc(const fp_allocator *mem, size_t count, size_t size);
+void mem_free(const fp_allocator *mem, void *ptr);
+void* mem_alloc_aligned(const fp_allocator *mem, size_t size);
+void mem_free_aligned(const fp_allocator *mem, void *ptr);
+
+/*
+    shared tables that live as long as the process,
+    always from the system allocator, aligned
+*/
+void* table_alloc(size_t size);
+void table_free(void *ptr);
+
 #if defined(WIN32) || defined(SLOWROUND) || defined(WIN64)
 int const round(const float x);
 #endif
@@ -0,0 +1,854 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+
+/*
+    Distance between two packed fingerprints.
+
+    Spectral fits are 2-bit codes 0..3 and are compared
+    by how far apart they are. Written as a thermometer,
+    a >= 1, a >= 2, a >= 3, the distance |a - b| is the
+    number of those three bits that differ, so whole
+    words of codes are compared with and, or, xor and a
+    bit count, without unpacking them. Dominant lines
+    are 6-bit codes and only count when they differ.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "compare.h"
+
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+                          || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define COMPARE_SSE2
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define TARGET(x) __attribute__((target(x)))
+#else
+#define TARGET(x)
+#endif
+
+/*
+    with a bound, the distance so far is checked
+    after every block of this many bytes
+*/
+#define R_BLOCK         128
+
+/*
+    largest possible avg_fit and avg_dom
+*/
+#define FIT_MAX         3000
+#define AVGDOM_MAX      6300
+
+#define M2  0x5555555555555555ULL
+#define M4  0x3333333333333333ULL
+#define M8  0x0F0F0F0F0F0F0F0FULL
+
+/*
+    the lowest bit of each 6-bit field of 48
+*/
+#define M6  0x041041041041ULL
+
+int compare_simd_level(void)
+{
+#if defined(COMPARE_SSE2) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx512bw")
+        && __builtin_cpu_supports("avx512vpopcntdq")) {
+        return CMP_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return CMP_AVX2;
+    }
+#endif
+#if defined(COMPARE_SSE2)
+    return CMP_SSE2;
+#else
+    return CMP_SCALAR;
+#endif
+}
+
+/*
+    sum of |a - b| over the 32 codes in a word
+
+    per code, the bits of a >= 1 and a >= 2 that
+    differ are put side by side in u, and that of
+    a >= 3 in v, so adding up the bits of u per
+    code and v gives the distance of each code
+*/
+static int r_word(const unsigned long long a, const unsigned long long b)
+{
+    unsigned long long a1 = a >> 1, b1 = b >> 1;
+    unsigned long long x = a ^ b;
+    unsigned long long u, v;
+
+    u = ((((a | a1) ^ (b | b1)) ^ x) & M2) ^ x;
+    v = ((a & a1) ^ (b & b1)) & M2;
+
+    x = u - ((u >> 1) & M2) + v;
+    x = (x & M4) + ((x >> 2) & M4);
+    x = (x + (x >> 4)) & M8;
+
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+static unsigned long long load64(const unsigned char *p)
+{
+    unsigned long long x;
+
+    memcpy(&x, p, sizeof(x));
+
+    return x;
+}
+
+static unsigned int load32(const unsigned char *p)
+{
+    unsigned int x;
+
+    memcpy(&x, p, sizeof(x));
+
+    return x;
+}
+
+static int r_scalar(const unsigned char *r1, const unsigned char *r2,
+                    const int bytes, const int bound)
+{
+    int dist = 0;
+    int i;
+
+    for (i = 0; i + 8 <= bytes; i += 8) {
+        dist += r_word(load64(r1 + i), load64(r2 + i));
+
+        if (((i + 8) % R_BLOCK) == 0 && bound <= R_MAX && dist >= bound) {
+            return dist;
+        }
+    }
+
+    if (i < bytes) {
+        dist += r_word(load32(r1 + i), load32(r2 + i));
+    }
+
+    return dist;
+}
+
+#if defined(COMPARE_SSE2)
+/*
+    as r_word, for the 64 codes in a vector,
+    giving the sums in the two 64-bit halves
+*/
+static __m128i r_sse2_vector(const __m128i a, const __m128i b)
+{
+    const __m128i m2 = _mm_set1_epi8(0x55);
+    const __m128i m4 = _mm_set1_epi8(0x33);
+    const __m128i m8 = _mm_set1_epi8(0x0F);
+    __m128i a1 = _mm_srli_epi64(a, 1), b1 = _mm_srli_epi64(b, 1);
+    __m128i x = _mm_xor_si128(a, b);
+    __m128i u, v;
+
+    u = _mm_xor_si128(_mm_or_si128(a, a1), _mm_or_si128(b, b1));
+    u = _mm_xor_si128(_mm_and_si128(_mm_xor_si128(u, x), m2), x);
+    v = _mm_and_si128(_mm_xor_si128(_mm_and_si128(a, a1), _mm_and_si128(b, b1)), m2);
+
+    x = _mm_add_epi8(_mm_sub_epi8(u, _mm_and_si128(_mm_srli_epi64(u, 1), m2)), v);
+    x = _mm_add_epi8(_mm_and_si128(x, m4), _mm_and_si128(_mm_srli_epi64(x, 2), m4));
+    x = _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi64(x, 4)), m8);
+
+    return _mm_sad_epu8(x, _mm_setzero_si128());
+}
+
+static int r_sse2_sum(const __m128i acc)
+{
+    return _mm_cvtsi128_si32(_mm_add_epi64(acc, _mm_unpackhi_epi64(acc, acc)));
+}
+
+/*
+    the bytes left over after the whole vectors
+    come in a last vector that ends with the
+    span, with the bytes already seen cleared
+*/
+static int r_sse2(const unsigned char *r1, const unsigned char *r2,
+                  const int bytes, const int bound)
+{
+    static const unsigned char tail_mask[32] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+    };
+    const int last = bytes - 16;
+    __m128i acc = _mm_setzero_si128();
+    __m128i tail;
+    int i;
+
+    if (bytes < 16) {
+        return r_scalar(r1, r2, bytes, bound);
+    }
+
+    for (i = 0; i <= last; i += 16) {
+        acc = _mm_add_epi64(acc, r_sse2_vector(_mm_loadu_si128((const __m128i*)(r1 + i)),
+                                               _mm_loadu_si128((const __m128i*)(r2 + i))));
+
+        if (((i + 16) % R_BLOCK) == 0 && bound <= R_MAX && r_sse2_sum(acc) >= bound) {
+            return r_sse2_sum(acc);
+        }
+    }
+
+    if (bytes % 16 != 0) {
+        tail = _mm_loadu_si128((const __m128i*)(tail_mask + bytes % 16));
+        acc = _mm_add_epi64(acc, r_sse2_vector(_mm_and_si128(_mm_loadu_si128((const __m128i*)(r1 + last)), tail),
+                                               _mm_and_si128(_mm_loadu_si128((const __m128i*)(r2 + last)), tail)));
+    }
+
+    return r_sse2_sum(acc);
+}
+
+/*
+    as above, 128 codes at a time, the last
+    vector is loaded as far as the span goes
+*/
+TARGET("avx2")
+static int r_avx2_sum(const __m256i acc)
+{
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+
+    return _mm_cvtsi128_si32(_mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum)));
+}
+
+TARGET("avx2")
+static int r_avx2(const unsigned char *r1, const unsigned char *r2,
+                  const int bytes, const int bound)
+{
+    static const int tail_mask[16] = {
+        -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    const __m256i m2 = _mm256_set1_epi8(0x55);
+    const __m256i m4 = _mm256_set1_epi8(0x33);
+    const __m256i m8 = _mm256_set1_epi8(0x0F);
+    __m256i acc = _mm256_setzero_si256();
+    __m256i a, b, a1, b1, x, u, v, tail;
+    int i;
+
+    for (i = 0; i < bytes; i += 32) {
+        if (i + 32 <= bytes) {
+            a = _mm256_loadu_si256((const __m256i*)(r1 + i));
+            b = _mm256_loadu_si256((const __m256i*)(r2 + i));
+        } else {
+            tail = _mm256_loadu_si256((const __m256i*)(tail_mask + 8 - (bytes - i) / 4));
+            a = _mm256_maskload_epi32((const int*)(r1 + i), tail);
+            b = _mm256_maskload_epi32((const int*)(r2 + i), tail);
+        }
+        a1 = _mm256_srli_epi64(a, 1);
+        b1 = _mm256_srli_epi64(b, 1);
+        x = _mm256_xor_si256(a, b);
+
+        u = _mm256_xor_si256(_mm256_or_si256(a, a1), _mm256_or_si256(b, b1));
+        u = _mm256_xor_si256(_mm256_and_si256(_mm256_xor_si256(u, x), m2), x);
+        v = _mm256_and_si256(_mm256_xor_si256(_mm256_and_si256(a, a1), _mm256_and_si256(b, b1)), m2);
+
+        x = _mm256_add_epi8(_mm256_sub_epi8(u, _mm256_and_si256(_mm256_srli_epi64(u, 1), m2)), v);
+        x = _mm256_add_epi8(_mm256_and_si256(x, m4), _mm256_and_si256(_mm256_srli_epi64(x, 2), m4));
+        x = _mm256_and_si256(_mm256_add_epi8(x, _mm256_srli_epi64(x, 4)), m8);
+
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(x, _mm256_setzero_si256()));
+
+        if (((i + 32) % R_BLOCK) == 0 && bound <= R_MAX && r_avx2_sum(acc) >= bound) {
+            break;
+        }
+    }
+
+    return r_avx2_sum(acc);
+}
+
+/*
+    with a bit count instruction, 256 codes at a time:
+    u and v are counted as they are, and the bytes
+    at the end come in a masked load
+*/
+TARGET("avx512f,avx512bw,avx512vpopcntdq")
+static int r_avx512(const unsigned char *r1, const unsigned char *r2,
+                    const int bytes, const int bound)
+{
+    const __m512i m2 = _mm512_set1_epi8(0x55);
+    __m512i acc = _mm512_setzero_si512();
+    __m512i a, b, a1, b1, x, u, v;
+    __mmask64 mask = ~0ULL;
+    int i;
+
+    for (i = 0; i < bytes; i += 64) {
+        if (i + 64 > bytes) {
+            mask = (1ULL << (bytes - i)) - 1;
+        }
+        a = _mm512_maskz_loadu_epi8(mask, r1 + i);
+        b = _mm512_maskz_loadu_epi8(mask, r2 + i);
+        a1 = _mm512_srli_epi64(a, 1);
+        b1 = _mm512_srli_epi64(b, 1);
+        x = _mm512_xor_si512(a, b);
+
+        /*
+            u takes the even bits from the first
+            and the odd ones from x
+        */
+        u = _mm512_ternarylogic_epi64(m2, _mm512_xor_si512(_mm512_or_si512(a, a1),
+                                                           _mm512_or_si512(b, b1)), x, 0xCA);
+        v = _mm512_and_si512(_mm512_xor_si512(_mm512_and_si512(a, a1), _mm512_and_si512(b, b1)), m2);
+
+        acc = _mm512_add_epi64(acc, _mm512_add_epi64(_mm512_popcnt_epi64(u), _mm512_popcnt_epi64(v)));
+
+        if (((i + 64) % R_BLOCK) == 0 && bound <= R_MAX && _mm512_reduce_add_epi64(acc) >= bound) {
+            break;
+        }
+    }
+
+    return (int)_mm512_reduce_add_epi64(acc);
+}
+#endif
+
+int r_distance(const unsigned char *r1, const unsigned char *r2)
+{
+    return r_distance_bound(r1, r2, FP_R_BYTES, compare_simd_level(), R_MAX + 1);
+}
+
+int r_distance_bound(const unsigned char *r1, const unsigned char *r2, const int bytes,
+                     const int level, const int bound)
+{
+    switch (level) {
+#if defined(COMPARE_SSE2)
+    case CMP_AVX512:
+        return r_avx512(r1, r2, bytes, bound);
+    case CMP_AVX2:
+        return r_avx2(r1, r2, bytes, bound);
+    case CMP_SSE2:
+        return r_sse2(r1, r2, bytes, bound);
+#endif
+    default:
+        return r_scalar(r1, r2, bytes, bound);
+    }
+}
+
+/*
+    8 bytes as a big endian number, so the codes
+    go from the highest bits down
+*/
+static unsigned long long load_be64(const unsigned char *p)
+{
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(load64(p));
+#elif defined(_MSC_VER)
+    return _byteswap_uint64(load64(p));
+#else
+    return ((unsigned long long)p[0] << 56) | ((unsigned long long)p[1] << 48)
+         | ((unsigned long long)p[2] << 40) | ((unsigned long long)p[3] << 32)
+         | ((unsigned long long)p[4] << 24) | ((unsigned long long)p[5] << 16)
+         | ((unsigned long long)p[6] << 8)  |  (unsigned long long)p[7];
+#endif
+}
+
+/*
+    a flag in the lowest bit of each of the 8 codes
+    in the low 48 bits of x, for the codes that are
+    not zero
+*/
+static unsigned long long dom_flags(unsigned long long x)
+{
+    /*
+        fold the 6 bits of each code onto its
+        lowest one, which only ever takes in
+        bits of its own code
+    */
+    x |= x >> 1;
+    x |= x >> 2;
+    x |= x >> 2;
+
+    return x & M6;
+}
+
+int dom_distance(const unsigned char *dom1, const unsigned char *dom2)
+{
+    const int last = FP_DOM_BYTES - 8;
+    unsigned long long flags = 0;
+    int i, j;
+
+    /*
+        8 codes in each 6 bytes, each code counts
+        up to 11 in its own field
+
+        the last 6 bytes are read from 2 bytes early
+        to stay inside the field, and leave out the
+        padding code after frame 87
+    */
+    for (i = 0; i < FP_DOM_BYTES; i += 6) {
+        j = i < last ? i : last;
+        flags += dom_flags(((load_be64(dom1 + j) ^ load_be64(dom2 + j)) >> (8 * (j + 2 - i)))
+                           & (i < last ? ~0ULL : ~0x3FULL));
+    }
+
+    /*
+        add pairs of fields into 12 bits, then
+        those 4 up into the top one
+    */
+    flags = (flags & 0x03F03F03F03FULL) + ((flags >> 6) & 0x03F03F03F03FULL);
+
+    return (int)(((flags * 0x001001001001ULL) >> 36) & 0xFFF);
+}
+
+int get_short(const unsigned char *fp, const int offset)
+{
+    short x;
+
+    memcpy(&x, fp + offset, sizeof(x));
+
+    return x;
+}
+
+int get_int(const unsigned char *fp, const int offset)
+{
+    int x;
+
+    memcpy(&x, fp + offset, sizeof(x));
+
+    return x;
+}
+
+/*
+    is the entry at a worse than the one at b,
+    with the later id worse on a tie
+*/
+static int worse(const int *ids, const int *scores, const int a, const int b)
+{
+    return scores[a] > scores[b] || (scores[a] == scores[b] && ids[a] > ids[b]);
+}
+
+static void swap_entries(int *ids, int *scores, const int a, const int b)
+{
+    int t;
+
+    t = ids[a];    ids[a] = ids[b];       ids[b] = t;
+    t = scores[a]; scores[a] = scores[b]; scores[b] = t;
+}
+
+void sift_down(int *ids, int *scores, const int n, int i)
+{
+    int child;
+
+    while ((child = 2 * i + 1) < n) {
+        if (child + 1 < n && worse(ids, scores, child + 1, child)) {
+            child++;
+        }
+        if (!worse(ids, scores, child, i)) {
+            break;
+        }
+
+        swap_entries(ids, scores, i, child);
+        i = child;
+    }
+}
+
+void sift_up(int *ids, int *scores, int i)
+{
+    int parent;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!worse(ids, scores, i, parent)) {
+            break;
+        }
+
+        swap_entries(ids, scores, i, parent);
+        i = parent;
+    }
+}
+
+void heap_sort(int *ids, int *scores, const int n)
+{
+    int i;
+
+    for (i = n - 1; i > 0; i--) {
+        swap_entries(ids, scores, 0, i);
+        sift_down(ids, scores, i, 0);
+    }
+}
+
+static float ratio(long long diff, const long long max)
+{
+    if (diff < 0) {
+        diff = -diff;
+    }
+    if (diff == 0) {
+        return 0.0f;
+    }
+    if (max <= 0 || diff >= max) {
+        return 1.0f;
+    }
+
+    return (float)diff / (float)max;
+}
+
+/*
+    the terms of the header, which do not depend
+    on how the frames line up
+*/
+static float header_distance(const unsigned char *fp1, const unsigned char *fp2)
+{
+    int len1 = get_int(fp1, FP_LENGTH_OFFSET);
+    int len2 = get_int(fp2, FP_LENGTH_OFFSET);
+
+    return W_LENGTH * ratio((long long)len1 - len2, len1 > len2 ? len1 : len2)
+         + W_FIT * ratio(get_short(fp1, FP_FIT_OFFSET) - get_short(fp2, FP_FIT_OFFSET), FIT_MAX)
+         + W_AVGDOM * ratio(get_short(fp1, FP_AVGDOM_OFFSET) - get_short(fp2, FP_AVGDOM_OFFSET), AVGDOM_MAX);
+}
+
+/*
+    the distance over a number of lined up frames,
+    with r the fit distance and dom the number of
+    dominant lines that differ
+*/
+static float distance(const int r, const int dom, const int frames, const float header)
+{
+    return W_R * (float)r / (float)(3 * (MAX_BARK - 1) * frames)
+         + W_DOM * (float)dom / (float)frames
+         + header;
+}
+
+float compare_bound(const unsigned char *fp1, const unsigned char *fp2,
+                    const int level, const float bound)
+{
+    float header, room;
+    int dom, r, r_bound;
+
+    if (get_short(fp1, 0) != get_short(fp2, 0)) {
+        return 1.0f;
+    }
+
+    /*
+        the header and dominant lines first, as they
+        are cheap, and the fits only as far as the
+        room they leave under the bound
+    */
+    header = header_distance(fp1, fp2);
+    dom = dom_distance(fp1 + FP_DOM_OFFSET, fp2 + FP_DOM_OFFSET);
+
+    room = (bound - W_DOM * (float)dom / (float)ANFRAMES - header) * (float)R_MAX / W_R;
+    if (room <= 0.0f) {
+        return bound;
+    }
+    r_bound = room > (float)R_MAX ? R_MAX + 1 : (int)room + 1;
+
+    r = r_distance_bound(fp1 + FP_R_OFFSET, fp2 + FP_R_OFFSET, FP_R_BYTES, level, r_bound);
+    if (r >= r_bound) {
+        return bound;
+    }
+
+    return distance(r, dom, ANFRAMES, header);
+}
+
+FOOIDAPI float fp_compare(const unsigned char *fp1, const unsigned char *fp2)
+{
+    if (get_short(fp1, 0) != get_short(fp2, 0)) {
+        return 1.0f;
+    }
+
+    return distance(r_distance(fp1 + FP_R_OFFSET, fp2 + FP_R_OFFSET),
+                    dom_distance(fp1 + FP_DOM_OFFSET, fp2 + FP_DOM_OFFSET),
+                    ANFRAMES, header_distance(fp1, fp2));
+}
+
+/*
+    the dominant lines as 6 planes of 128 bits,
+    one for each bit of the codes, with frame f
+    at bit 127 - f, the lower 64 in [0] and the
+    upper in [1]
+
+    moving one fingerprint against the other by
+    some frames is then a shift of its planes
+*/
+#define DOM_PLANES      6
+
+/*
+    the 8 codes of the 6 bytes from i, read as in
+    dom_distance, in the low 48 bits
+*/
+static unsigned long long dom_chunk(const unsigned char *dom, const int i)
+{
+    const int last = FP_DOM_BYTES - 8;
+    int j = i < last ? i : last;
+
+    return i < FP_DOM_BYTES ? load_be64(dom + j) >> (8 * (j + 2 - i)) : 0;
+}
+
+#if defined(COMPARE_SSE2)
+/*
+    with the codes of 16 frames spread out to a
+    byte each, first frame highest, the top bit of
+    each byte after a shift is one bit of the codes
+*/
+static void dom_planes(const unsigned char *dom, unsigned long long planes[DOM_PLANES][2])
+{
+    __m128i v[(FP_DOM_BYTES / 6 + 1) / 2];
+    __m128i n, x;
+    int i, b;
+
+    for (i = 0; i < (FP_DOM_BYTES / 6 + 1) / 2; i++) {
+        x = _mm_set_epi64x((long long)dom_chunk(dom, 12 * i),
+                           (long long)dom_chunk(dom, 12 * i + 6));
+        x = _mm_or_si128(_mm_and_si128(_mm_slli_epi64(x, 8), _mm_set1_epi64x(0xFFFFFF00000000LL)),
+                         _mm_and_si128(x, _mm_set1_epi64x(0xFFFFFFLL)));
+        x = _mm_or_si128(_mm_and_si128(_mm_slli_epi64(x, 4), _mm_set1_epi64x(0x0FFF00000FFF0000LL)),
+                         _mm_and_si128(x, _mm_set1_epi64x(0x00000FFF00000FFFLL)));
+        v[i] = _mm_or_si128(_mm_and_si128(_mm_slli_epi64(x, 2), _mm_set1_epi64x(0x3F003F003F003F00LL)),
+                            _mm_and_si128(x, _mm_set1_epi64x(0x003F003F003F003FLL)));
+    }
+
+    for (b = 0; b < DOM_PLANES; b++) {
+        n = _mm_cvtsi32_si128(7 - b);
+        planes[b][1] = 0;
+        planes[b][0] = 0;
+
+        for (i = 0; i < 4; i++) {
+            planes[b][1] |= (unsigned long long)_mm_movemask_epi8(_mm_sll_epi16(v[i], n))
+                            << (48 - 16 * i);
+        }
+        for (i = 4; i < (FP_DOM_BYTES / 6 + 1) / 2; i++) {
+            planes[b][0] |= (unsigned long long)_mm_movemask_epi8(_mm_sll_epi16(v[i], n))
+                            << (112 - 16 * i);
+        }
+    }
+}
+#else
+/*
+    with the codes of 8 frames spread out to a byte
+    each, first frame highest, the multiply gathers
+    one bit of each into the top byte
+*/
+static void dom_planes(const unsigned char *dom, unsigned long long planes[DOM_PLANES][2])
+{
+    unsigned long long bytes[FP_DOM_BYTES / 6];
+    unsigned long long x;
+    int i, b;
+
+    for (i = 0; i < FP_DOM_BYTES / 6; i++) {
+        x = dom_chunk(dom, 6 * i);
+        x = ((x & 0xFFFFFF000000ULL) << 8) | (x & 0xFFFFFFULL);
+        x = ((x & 0x00FFF00000FFF000ULL) << 4) | (x & 0x00000FFF00000FFFULL);
+        bytes[i] = ((x & 0x0FC00FC00FC00FC0ULL) << 2) | (x & 0x003F003F003F003FULL);
+    }
+
+    for (b = 0; b < DOM_PLANES; b++) {
+        planes[b][1] = 0;
+        planes[b][0] = 0;
+
+        for (i = 0; i < 8; i++) {
+            planes[b][1] |= ((((bytes[i] >> b) & 0x0101010101010101ULL)
+                              * 0x0102040810204080ULL) >> 56) << (56 - 8 * i);
+        }
+        for (i = 8; i < FP_DOM_BYTES / 6; i++) {
+            planes[b][0] |= ((((bytes[i] >> b) & 0x0101010101010101ULL)
+                              * 0x0102040810204080ULL) >> 56) << (120 - 8 * i);
+        }
+    }
+}
+#endif
+
+/*
+    the top n bits of a word set, for n from 0 to
+    64, without ever shifting by 64
+*/
+static unsigned long long top_bits(const int n)
+{
+    return n > 0 ? ~0ULL << (64 - n) : 0;
+}
+
+/*
+    how many of the first n dominant lines differ
+    once the planes of p are shifted up by u frames
+
+    shifting one fingerprint or the other always
+    lines up the frames they share at the top
+*/
+#if defined(COMPARE_SSE2)
+static int dom_mismatches(unsigned long long p[DOM_PLANES][2],
+                          unsigned long long q[DOM_PLANES][2],
+                          const int u, const int n)
+{
+    const __m128i up = _mm_cvtsi32_si128(u);
+    const __m128i down = _mm_cvtsi32_si128(64 - u);
+    const __m128i m2 = _mm_set1_epi8(0x55);
+    const __m128i m4 = _mm_set1_epi8(0x33);
+    const __m128i m8 = _mm_set1_epi8(0x0F);
+    __m128i d = _mm_setzero_si128();
+    __m128i v;
+    int b;
+
+    for (b = 0; b < DOM_PLANES; b++) {
+        v = _mm_loadu_si128((const __m128i*)p[b]);
+        v = _mm_or_si128(_mm_sll_epi64(v, up), _mm_slli_si128(_mm_srl_epi64(v, down), 8));
+        d = _mm_or_si128(d, _mm_xor_si128(v, _mm_loadu_si128((const __m128i*)q[b])));
+    }
+
+    d = _mm_and_si128(d, _mm_set_epi64x((long long)top_bits(n < 64 ? n : 64),
+                                        (long long)top_bits(n > 64 ? n - 64 : 0)));
+
+    d = _mm_sub_epi8(d, _mm_and_si128(_mm_srli_epi64(d, 1), m2));
+    d = _mm_add_epi8(_mm_and_si128(d, m4), _mm_and_si128(_mm_srli_epi64(d, 2), m4));
+    d = _mm_sad_epu8(_mm_and_si128(_mm_add_epi8(d, _mm_srli_epi64(d, 4)), m8),
+                     _mm_setzero_si128());
+
+    return _mm_cvtsi128_si32(_mm_add_epi64(d, _mm_unpackhi_epi64(d, d)));
+}
+#else
+static int bits64(unsigned long long x)
+{
+    x = x - ((x >> 1) & M2);
+    x = (x & M4) + ((x >> 2) & M4);
+    x = (x + (x >> 4)) & M8;
+
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+static int dom_mismatches(unsigned long long p[DOM_PLANES][2],
+                          unsigned long long q[DOM_PLANES][2],
+                          const int u, const int n)
+{
+    unsigned long long hi = 0, lo = 0;
+    unsigned long long h, l;
+    int b;
+
+    for (b = 0; b < DOM_PLANES; b++) {
+        h = p[b][1];
+        l = p[b][0];
+
+        if (u > 0) {
+            h = (h << u) | (l >> (64 - u));
+            l <<= u;
+        }
+
+        hi |= h ^ q[b][1];
+        lo |= l ^ q[b][0];
+    }
+
+    hi &= top_bits(n < 64 ? n : 64);
+    lo &= top_bits(n > 64 ? n - 64 : 0);
+
+    return bits64(hi) + bits64(lo);
+}
+#endif
+
+/*
+    order in which shifts win a tie: the nearest
+    first, and a positive one before a negative
+*/
+static int shift_rank(const int s)
+{
+    return s > 0 ? 2 * s - 1 : -2 * s;
+}
+
+FOOIDAPI float fp_compare_shifted(const unsigned char *fp1, const unsigned char *fp2,
+                                  int max_shift, int *shift)
+{
+    unsigned long long planes1[DOM_PLANES][2], planes2[DOM_PLANES][2];
+    int order_shift[ANFRAMES];
+    int order_miss[ANFRAMES];
+    int order_n[ANFRAMES];
+    int shifts, best_shift = 0;
+    float header, dist, best, room;
+    int level, bound;
+    int s, n, a, miss, r;
+    int i, j;
+
+    if (shift != NULL) {
+        *shift = 0;
+    }
+
+    if (get_short(fp1, 0) != get_short(fp2, 0)) {
+        return 1.0f;
+    }
+
+    if (max_shift < 0) {
+        max_shift = 0;
+    }
+    if (max_shift > ANFRAMES / 2) {
+        max_shift = ANFRAMES / 2;
+    }
+
+    /*
+        slide the dominant lines of one over the
+        other, and order the shifts by how few of
+        them differ, nearest shifts first on a tie,
+        so that the best shift tends to come early
+    */
+    dom_planes(fp1 + FP_DOM_OFFSET, planes1);
+    dom_planes(fp2 + FP_DOM_OFFSET, planes2);
+
+    shifts = 2 * max_shift + 1;
+
+    for (i = 0; i < shifts; i++) {
+        s = (i & 1) ? (i + 1) / 2 : -(i / 2);
+        n = ANFRAMES - (s < 0 ? -s : s);
+        miss = s > 0 ? dom_mismatches(planes2, planes1, s, n)
+                     : dom_mismatches(planes1, planes2, -s, n);
+
+        for (j = i; j > 0 && miss * order_n[j - 1] < order_miss[j - 1] * n; j--) {
+            order_shift[j] = order_shift[j - 1];
+            order_miss[j] = order_miss[j - 1];
+            order_n[j] = order_n[j - 1];
+        }
+        order_shift[j] = s;
+        order_miss[j] = miss;
+        order_n[j] = n;
+    }
+
+    /*
+        score the fits at every shift, giving up on
+        one once it is clearly worse than the best
+        so far; the bound leaves a code of room, so
+        that rounding never passes over a tie
+    */
+    header = header_distance(fp1, fp2);
+    level = compare_simd_level();
+    best = 2.0f;
+
+    for (i = 0; i < shifts; i++) {
+        s = order_shift[i];
+        n = order_n[i];
+        a = s < 0 ? -s : 0;
+
+        room = (best - W_DOM * (float)order_miss[i] / (float)n - header)
+             * (float)(3 * (MAX_BARK - 1) * n) / W_R;
+        if (room < -1.0f) {
+            continue;
+        }
+        bound = room >= (float)R_MAX ? R_MAX + 1 : (int)(room + 1.0f) + 1;
+
+        r = r_distance_bound(fp1 + FP_R_OFFSET + FP_R_FRAME * a,
+                             fp2 + FP_R_OFFSET + FP_R_FRAME * (a + s),
+                             FP_R_FRAME * n, level, bound);
+        if (r >= bound) {
+            continue;
+        }
+
+        dist = distance(r, order_miss[i], n, header);
+        if (dist < best || (dist == best && shift_rank(s) < shift_rank(best_shift))) {
+            best = dist;
+            best_shift = s;
+        }
+    }
+
+    if (shift != NULL) {
+        *shift = best_shift;
+    }
+
+    return best;
+}
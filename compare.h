@@ -0,0 +1,95 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+
+#ifndef COMPARE_H
+#define COMPARE_H
+
+/*
+    instruction set levels of the distance kernels
+*/
+#define CMP_SCALAR      0
+#define CMP_SSE2        1
+#define CMP_AVX2        2
+#define CMP_AVX512      3
+
+/*
+    weights of the terms of fp_compare, they add up to 1
+*/
+#define W_R             0.50f
+#define W_DOM           0.30f
+#define W_LENGTH        0.10f
+#define W_FIT           0.05f
+#define W_AVGDOM        0.05f
+
+/*
+    largest distance between spectral fits
+*/
+#define R_CODES         (ANFRAMES * (MAX_BARK - 1))
+#define R_MAX           (3 * R_CODES)
+
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch((p), 0, 0)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_NTA)
+#else
+#define PREFETCH(p)
+#endif
+
+#define CACHE_LINE      64
+
+/*
+    funcs
+*/
+int compare_simd_level(void);
+
+/*
+    over bytes of fits, a multiple of 4 up to
+    FP_R_BYTES, stopping early with a partial
+    distance of at least bound once the distance
+    reaches it
+*/
+int r_distance_bound(const unsigned char *r1, const unsigned char *r2, const int bytes,
+                     const int level, const int bound);
+int r_distance(const unsigned char *r1, const unsigned char *r2);
+int dom_distance(const unsigned char *dom1, const unsigned char *dom2);
+
+/*
+    header fields of a packed fingerprint
+*/
+int get_short(const unsigned char *fp, const int offset);
+int get_int(const unsigned char *fp, const int offset);
+
+/*
+    a max-heap of the k best so far, ids with their
+    scores, the worst at the top and the later id
+    worse on a tie: sift_down moves entry i down a
+    heap of n, sift_up moves entry i up, and
+    heap_sort sorts a heap of n, best first
+*/
+void sift_down(int *ids, int *scores, const int n, int i);
+void sift_up(int *ids, int *scores, int i);
+void heap_sort(int *ids, int *scores, const int n);
+
+/*
+    the distance of fp_compare, or at least bound
+    once it is clear that it is not below it
+*/
+float compare_bound(const unsigned char *fp1, const unsigned char *fp2,
+                    const int level, const float bound);
+
+#endif
@@ -0,0 +1,262 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+/*
+    Input conversion: finding the start of the sound
+    and mixing interleaved input down to mono floats.
+
+    The vector versions compute exactly what the scalar
+    ones do, so the results never depend on the path
+    taken.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include "common.h"
+#include "downmix.h"
+
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+                          || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define DOWNMIX_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+    find the first frame that has any sound in it,
+    any nonzero 16-bit sample counts
+
+    input  * interleaved samples
+           * number of frames
+           * number of channels
+
+    output * index of the first frame with sound,
+             len if there is none
+*/
+int sound_start_short(const short *data, int len, int channels)
+{
+    const int total = len * channels;
+    int i = 0;
+
+#if defined(DOWNMIX_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 8 <= total; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&data[i]);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)) != 0xFFFF) {
+            break;
+        }
+    }
+#endif
+
+    for (; i < total; i++) {
+        if (data[i] != 0) {
+            return i / channels;
+        }
+    }
+
+    return len;
+}
+
+/*
+    as above, for float input, anything at
+    or above the 16-bit quantization step counts
+*/
+int sound_start_float(const float *data, int len, int channels)
+{
+    const int total = len * channels;
+    int i = 0;
+
+#if defined(DOWNMIX_SSE2)
+    const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 thresh  = _mm_set1_ps(1.0f/32768.0f);
+
+    for (; i + 16 <= total; i += 16) {
+        __m128 m0 = _mm_cmpge_ps(_mm_and_ps(_mm_loadu_ps(&data[i]),      absmask), thresh);
+        __m128 m1 = _mm_cmpge_ps(_mm_and_ps(_mm_loadu_ps(&data[i + 4]),  absmask), thresh);
+        __m128 m2 = _mm_cmpge_ps(_mm_and_ps(_mm_loadu_ps(&data[i + 8]),  absmask), thresh);
+        __m128 m3 = _mm_cmpge_ps(_mm_and_ps(_mm_loadu_ps(&data[i + 12]), absmask), thresh);
+        if (_mm_movemask_ps(_mm_or_ps(_mm_or_ps(m0, m1), _mm_or_ps(m2, m3))) != 0) {
+            break;
+        }
+    }
+#endif
+
+    for (; i < total; i++) {
+        if (fabs(data[i]) >= (1.0f/32768.0f - EPSILON)) {
+            return i / channels;
+        }
+    }
+
+    return len;
+}
+
+#if defined(DOWNMIX_SSE2)
+/*
+    sum 4 channels of 4 consecutive frames, a to d
+    hold the frames, acc gets the per frame sums
+    added in channel order
+*/
+#define ADD_TRANSPOSED(acc, a, b, c, d)     \
+    do {                                    \
+        __m128 t0 = (a), t1 = (b);          \
+        __m128 t2 = (c), t3 = (d);          \
+        _MM_TRANSPOSE4_PS(t0, t1, t2, t3);  \
+        acc = _mm_add_ps(acc, t0);          \
+        acc = _mm_add_ps(acc, t1);          \
+        acc = _mm_add_ps(acc, t2);          \
+        acc = _mm_add_ps(acc, t3);          \
+    } while (0)
+#endif
+
+/*
+    downmix float input
+
+    input  * interleaved samples
+           * number of frames
+           * number of channels
+           * output buffer, len floats
+*/
+void downmix_float(const float *data, int len, int channels, float *out)
+{
+    int pos = 0;
+    int c;
+    float accum;
+
+#if defined(DOWNMIX_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 nch  = _mm_set1_ps((float)channels);
+    __m128 acc, lo, hi;
+
+    if (channels == 1) {
+        for (; pos + 4 <= len; pos += 4) {
+            _mm_storeu_ps(&out[pos], _mm_add_ps(zero, _mm_loadu_ps(&data[pos])));
+        }
+    } else if (channels == 2) {
+        for (; pos + 4 <= len; pos += 4) {
+            lo  = _mm_loadu_ps(&data[pos * 2]);
+            hi  = _mm_loadu_ps(&data[pos * 2 + 4]);
+            acc = _mm_add_ps(zero, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+            acc = _mm_add_ps(acc,  _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_ps(&out[pos], _mm_div_ps(acc, nch));
+        }
+    } else if (channels == 6) {
+        /*
+            5.1: channels 0-3 by transposing, 4 and 5
+            are picked out in pairs
+        */
+        for (; pos + 4 <= len; pos += 4) {
+            const float *d = &data[pos * 6];
+
+            acc = zero;
+            ADD_TRANSPOSED(acc, _mm_loadu_ps(d),      _mm_loadu_ps(d + 6),
+                                _mm_loadu_ps(d + 12), _mm_loadu_ps(d + 18));
+
+            lo = _mm_loadh_pi(_mm_loadl_pi(zero, (const __m64*)(d + 4)),  (const __m64*)(d + 10));
+            hi = _mm_loadh_pi(_mm_loadl_pi(zero, (const __m64*)(d + 16)), (const __m64*)(d + 22));
+            acc = _mm_add_ps(acc, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+            acc = _mm_add_ps(acc, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+
+            _mm_storeu_ps(&out[pos], _mm_div_ps(acc, nch));
+        }
+    } else if (channels == 8) {
+        /*
+            7.1: two transposed blocks of 4 channels
+        */
+        for (; pos + 4 <= len; pos += 4) {
+            const float *d = &data[pos * 8];
+
+            acc = zero;
+            ADD_TRANSPOSED(acc, _mm_loadu_ps(d),      _mm_loadu_ps(d + 8),
+                                _mm_loadu_ps(d + 16), _mm_loadu_ps(d + 24));
+            ADD_TRANSPOSED(acc, _mm_loadu_ps(d + 4),  _mm_loadu_ps(d + 12),
+                                _mm_loadu_ps(d + 20), _mm_loadu_ps(d + 28));
+
+            _mm_storeu_ps(&out[pos], _mm_div_ps(acc, nch));
+        }
+    }
+#endif
+
+    for (; pos < len; pos++) {
+        accum = 0;
+        for (c = 0; c < channels; c++) {
+            accum += data[(pos * channels) + c];
+        }
+        accum /= (float)channels;
+
+        out[pos] = accum;
+    }
+}
+
+#if defined(DOWNMIX_SSE2)
+/*
+    8 shorts to 2 x 4 floats, scaled to [-1, 1]
+*/
+static void short8_to_float(const short *data, __m128 *lo, __m128 *hi)
+{
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    __m128i v = _mm_loadu_si128((const __m128i*)data);
+
+    *lo = _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale);
+    *hi = _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), scale);
+}
+#endif
+
+/*
+    convert and downmix 16-bit input
+
+    input  * interleaved samples
+           * number of frames
+           * number of channels
+           * output buffer, len floats
+*/
+void downmix_short(const short *data, int len, int channels, float *out)
+{
+    int pos = 0;
+    int c;
+    float accum;
+
+#if defined(DOWNMIX_SSE2)
+    __m128 lo, hi;
+
+    if (channels == 1) {
+        for (; pos + 8 <= len; pos += 8) {
+            short8_to_float(&data[pos], &lo, &hi);
+            _mm_storeu_ps(&out[pos],     lo);
+            _mm_storeu_ps(&out[pos + 4], hi);
+        }
+    } else if (channels == 2) {
+        const __m128 two = _mm_set1_ps(2.0f);
+
+        for (; pos + 4 <= len; pos += 4) {
+            short8_to_float(&data[pos * 2], &lo, &hi);
+            _mm_storeu_ps(&out[pos],
+                _mm_div_ps(_mm_add_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)),
+                                      _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))),
+                           two));
+        }
+    }
+#endif
+
+    for (; pos < len; pos++) {
+        accum = 0;
+        for (c = 0; c < channels; c++) {
+            accum += data[(pos * channels) + c] / 32767.0f;
+        }
+        accum /= (float)channels;
+
+        out[pos] = accum;
+    }
+}
@@ -0,0 +1,25 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef DOWNMIX_H
+#define DOWNMIX_H
+
+int sound_start_short(const short *data, int len, int channels);
+void downmix_short(const short *data, int len, int channels, float *out);
+int sound_start_float(const float *data, int len, int channels);
+void downmix_float(const float *data, int len, int channels, float *out);
+
+#endif
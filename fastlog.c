@@ -0,0 +1,377 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+/*
+    Power spectrum in dB without libm.
+
+    The natural log is taken apart into the float
+    exponent and a polynomial on the mantissa (the
+    Cephes logf approximation), evaluated in single
+    precision. Over the powers we see, 1e-15 up to
+    1e12, the result is within 3.1e-5 dB (2.2e-7
+    relative) of (float)log(x) * 4.34294480f, enough
+    to move a band fit across a quantization step
+    only in rare cases.
+
+    The AVX, SSE2 and scalar versions do the same
+    operations in the same order, so the results
+    never depend on the path taken.
+*/
+
+#include <string.h>
+#include "common.h"
+#include "s_fft_simd.h"
+#include "fastlog.h"
+
+#if !defined(FOOID_EXACT_LOG)
+
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+                          || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FASTLOG_SSE2
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define TARGET(x) __attribute__((target(x)))
+#else
+#define TARGET(x)
+#endif
+
+#define SQRTHF      0.707106781186547524f
+#define LOG_Q1     -2.12194440e-4f
+#define LOG_Q2      0.693359375f
+#define DB_SCALE    4.34294480f
+
+/*
+    the largest float not above EPSILON, so that
+    power <= DB_FLOOR in single precision floors
+    the same powers as power <= EPSILON in double
+    does on the exact path; (float)EPSILON would
+    round up and floor one power more
+*/
+#define DB_FLOOR    9.999998977e-16f
+
+#define LOG_P0      7.0376836292e-2f
+#define LOG_P1     -1.1514610310e-1f
+#define LOG_P2      1.1676998740e-1f
+#define LOG_P3     -1.2420140846e-1f
+#define LOG_P4      1.4249322787e-1f
+#define LOG_P5     -1.6668057665e-1f
+#define LOG_P6      2.0000714765e-1f
+#define LOG_P7     -2.4999993993e-1f
+#define LOG_P8      3.3333331174e-1f
+
+/*
+    dB value of one power, for x > DB_FLOOR
+*/
+static float db_scalar(const float x)
+{
+    unsigned int bits;
+    float m, e, z, y;
+
+    memcpy(&bits, &x, sizeof(bits));
+
+    /*
+        x = m * 2^e, m in [0.5, 1)
+    */
+    e = (float)((int)(bits >> 23) - 126);
+    bits = (bits & 0x807FFFFF) | 0x3F000000;
+    memcpy(&m, &bits, sizeof(m));
+
+    /*
+        move m to [sqrt(0.5), sqrt(2)) - 1
+    */
+    if (m < SQRTHF) {
+        e = e - 1.0f;
+        m = (m + m) - 1.0f;
+    } else {
+        m = m - 1.0f;
+    }
+
+    z = m * m;
+
+    y = LOG_P0 * m + LOG_P1;
+    y = y * m + LOG_P2;
+    y = y * m + LOG_P3;
+    y = y * m + LOG_P4;
+    y = y * m + LOG_P5;
+    y = y * m + LOG_P6;
+    y = y * m + LOG_P7;
+    y = y * m + LOG_P8;
+    y = (y * m) * z;
+
+    y = y + LOG_Q1 * e;
+    y = y - 0.5f * z;
+    m = m + y;
+    m = m + LOG_Q2 * e;
+
+    return m * DB_SCALE;
+}
+
+#if defined(FASTLOG_SSE2)
+/*
+    as above, 4 powers at a time
+*/
+static __m128 db_sse2(const __m128 x)
+{
+    const __m128i mantmask = _mm_set1_epi32(0x807FFFFF);
+    const __m128i half     = _mm_set1_epi32(0x3F000000);
+    const __m128 one       = _mm_set1_ps(1.0f);
+    __m128i bits = _mm_castps_si128(x);
+    __m128 m, e, z, y, lt;
+
+    e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+    m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, mantmask), half));
+
+    lt = _mm_cmplt_ps(m, _mm_set1_ps(SQRTHF));
+    e = _mm_sub_ps(e, _mm_and_ps(lt, one));
+    m = _mm_sub_ps(_mm_add_ps(m, _mm_and_ps(lt, m)), one);
+
+    z = _mm_mul_ps(m, m);
+
+    y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(LOG_P0), m), _mm_set1_ps(LOG_P1));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P2));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P3));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P4));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P5));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P6));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P7));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(LOG_P8));
+    y = _mm_mul_ps(_mm_mul_ps(y, m), z);
+
+    y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(LOG_Q1), e));
+    y = _mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+    m = _mm_add_ps(m, y);
+    m = _mm_add_ps(m, _mm_mul_ps(_mm_set1_ps(LOG_Q2), e));
+
+    return _mm_mul_ps(m, _mm_set1_ps(DB_SCALE));
+}
+
+/*
+    pick the strongest of n lanes and fold it into the
+    running maximum, the lowest line among equals, so
+    the result is the first strict maximum overall
+*/
+static void merge_max(const float *lmax, const int *lid, const int n,
+                      float *maxpower, int *maxid)
+{
+    int k;
+
+    for (k = 0; k < n; k++) {
+        if (lmax[k] > *maxpower || (lmax[k] == *maxpower && lid[k] < *maxid)) {
+            *maxpower = lmax[k];
+            *maxid = lid[k];
+        }
+    }
+}
+
+/*
+    4 lines at a time
+
+    output * number of lines done
+*/
+static int dbpower_sse2(const t_complex *work, float *dbpower, const int start,
+                        const int len, float *maxpower, int *maxid)
+{
+    const float *w = (const float *)work;
+    const __m128 eps = _mm_set1_ps(DB_FLOOR);
+    const __m128i four = _mm_set1_epi32(4);
+    __m128 vmax = _mm_setzero_ps();
+    __m128i vid = _mm_setzero_si128();
+    __m128i idx = _mm_setr_epi32(start, start + 1, start + 2, start + 3);
+    float lmax[4];
+    int lid[4];
+    int i;
+
+    for (i = start; i + 4 <= len; i += 4) {
+        __m128 a  = _mm_loadu_ps(&w[2 * i]);
+        __m128 b  = _mm_loadu_ps(&w[2 * i + 4]);
+        __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 p  = _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+        __m128 gt = _mm_cmpgt_ps(p, vmax);
+
+        /*
+            per lane first strict maximum
+        */
+        vmax = _mm_or_ps(_mm_and_ps(gt, p), _mm_andnot_ps(gt, vmax));
+        vid  = _mm_or_si128(_mm_and_si128(_mm_castps_si128(gt), idx),
+                            _mm_andnot_si128(_mm_castps_si128(gt), vid));
+        idx  = _mm_add_epi32(idx, four);
+
+        /*
+            anything at or below EPSILON is 0 dB
+        */
+        _mm_storeu_ps(&dbpower[i], _mm_and_ps(_mm_cmpgt_ps(p, eps), db_sse2(p)));
+    }
+
+    _mm_storeu_ps(lmax, vmax);
+    _mm_storeu_si128((__m128i*)lid, vid);
+    merge_max(lmax, lid, 4, maxpower, maxid);
+
+    return i;
+}
+
+#if defined(FFT_X86)
+/*
+    as db_sse2, 8 powers at a time, AVX has no 256-bit
+    integer operations, so the exponent and mantissa
+    are taken apart in two halves
+*/
+TARGET("avx")
+static __m256 db_avx(const __m256 x)
+{
+    const __m128i mantmask = _mm_set1_epi32(0x807FFFFF);
+    const __m128i half     = _mm_set1_epi32(0x3F000000);
+    const __m128i bias     = _mm_set1_epi32(126);
+    const __m256 one       = _mm256_set1_ps(1.0f);
+    __m128i lo = _mm_castps_si128(_mm256_castps256_ps128(x));
+    __m128i hi = _mm_castps_si128(_mm256_extractf128_ps(x, 1));
+    __m256 m, e, z, y, lt;
+
+    e = _mm256_insertf128_ps(_mm256_castps128_ps256(
+            _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(lo, 23), bias))),
+            _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(hi, 23), bias)), 1);
+    m = _mm256_insertf128_ps(_mm256_castps128_ps256(
+            _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(lo, mantmask), half))),
+            _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(hi, mantmask), half)), 1);
+
+    lt = _mm256_cmp_ps(m, _mm256_set1_ps(SQRTHF), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(lt, one));
+    m = _mm256_sub_ps(_mm256_add_ps(m, _mm256_and_ps(lt, m)), one);
+
+    z = _mm256_mul_ps(m, m);
+
+    y = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(LOG_P0), m), _mm256_set1_ps(LOG_P1));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(LOG_P2));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(LOG_P3));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(LOG_P4));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(LOG_P5));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(LOG_P6));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(LOG_P7));
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(LOG_P8));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+
+    y = _mm256_add_ps(y, _mm256_mul_ps(_mm256_set1_ps(LOG_Q1), e));
+    y = _mm256_sub_ps(y, _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+    m = _mm256_add_ps(m, y);
+    m = _mm256_add_ps(m, _mm256_mul_ps(_mm256_set1_ps(LOG_Q2), e));
+
+    return _mm256_mul_ps(m, _mm256_set1_ps(DB_SCALE));
+}
+
+/*
+    8 lines at a time, line numbers are kept
+    as floats, they are exact far beyond SPEC_LEN
+
+    output * number of lines done
+*/
+TARGET("avx")
+static int dbpower_avx(const t_complex *work, float *dbpower, const int len,
+                       float *maxpower, int *maxid)
+{
+    const float *w = (const float *)work;
+    const __m256 eps = _mm256_set1_ps(DB_FLOOR);
+    const __m256 eight = _mm256_set1_ps(8.0f);
+    __m256 vmax = _mm256_setzero_ps();
+    __m256 vid = _mm256_setzero_ps();
+    __m256 idx = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    float lmax[8];
+    float fid[8];
+    int lid[8];
+    int i, k;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256 a  = _mm256_loadu_ps(&w[2 * i]);
+        __m256 b  = _mm256_loadu_ps(&w[2 * i + 8]);
+        /*
+            ab holds lines 0 1 | 4 5, cd lines 2 3 | 6 7,
+            so the in-lane shuffles give them in order
+        */
+        __m256 ab = _mm256_permute2f128_ps(a, b, 0x20);
+        __m256 cd = _mm256_permute2f128_ps(a, b, 0x31);
+        __m256 re = _mm256_shuffle_ps(ab, cd, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 im = _mm256_shuffle_ps(ab, cd, _MM_SHUFFLE(3, 1, 3, 1));
+        __m256 p  = _mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im));
+        __m256 gt = _mm256_cmp_ps(p, vmax, _CMP_GT_OQ);
+        __m256 db = _mm256_and_ps(_mm256_cmp_ps(p, eps, _CMP_GT_OQ), db_avx(p));
+
+        vmax = _mm256_blendv_ps(vmax, p, gt);
+        vid  = _mm256_blendv_ps(vid, idx, gt);
+        idx  = _mm256_add_ps(idx, eight);
+
+        _mm256_storeu_ps(&dbpower[i], db);
+    }
+
+    _mm256_storeu_ps(lmax, vmax);
+    _mm256_storeu_ps(fid, vid);
+    for (k = 0; k < 8; k++) {
+        lid[k] = (int)fid[k];
+    }
+    merge_max(lmax, lid, 8, maxpower, maxid);
+
+    return i;
+}
+#endif
+#endif
+
+/*
+    get the power spectrum in dB, and in the same pass
+    the spectral line with the most power, like
+    get_dbpower but with the log above
+
+    input  * FFT output
+           * output buffer, len floats
+           * number of lines
+           * instruction set level, see s_fft_simd.h
+
+    output * index of the strongest line
+*/
+int get_dbpower_fast(const t_complex *work, float *dbpower, const int len, const int simd)
+{
+    int i = 0;
+    float power;
+    float maxpower = 0.0f;
+    int maxid = 0;
+
+#if defined(FASTLOG_SSE2)
+#if defined(FFT_X86)
+    if (simd >= FFT_AVX) {
+        i = dbpower_avx(work, dbpower, len, &maxpower, &maxid);
+    }
+#endif
+    i = dbpower_sse2(work, dbpower, i, len, &maxpower, &maxid);
+#endif
+
+    for (; i < len; i++) {
+        power = (work[i].re * work[i].re) + (work[i].im * work[i].im);
+
+        if (power > maxpower) {
+            maxpower = power;
+            maxid = i;
+        }
+
+        if (power <= DB_FLOOR) {
+            dbpower[i] = 0.0f;
+        } else {
+            dbpower[i] = db_scalar(power);
+        }
+    }
+
+    return maxid;
+}
+
+#endif
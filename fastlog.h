@@ -0,0 +1,30 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef FASTLOG_H
+#define FASTLOG_H
+
+#include "s_fft.h"
+
+/*
+    the fast path is left out entirely when
+    building with FOOID_EXACT_LOG
+*/
+#if !defined(FOOID_EXACT_LOG)
+int get_dbpower_fast(const t_complex *work, float *dbpower, const int len, const int simd);
+#endif
+
+#endif
@@ -25,72 +25,256 @@
 #include "fooid.h"
 
 #include "spectrum.h"
+#include "downmix.h"
 #include "libresample/resample.h"
 
 /* The original code seemed to assume that min() was a part of the standard library.
-   Since it isn't, I've added a simple implementation. */
-#if !defined(WIN32) && !defined(WIN64)
-int min(int a, int b) { return (a < b) ? a : b; }
-#endif
+   Since it isn't, I've added a simple implementation, static so it can't clash with
+   the min() of the program linking us or with the one of Windows headers. */
+static int min_int(int a, int b) { return (a < b) ? a : b; }
+
+
+/*
+    forget everything about the previous song
+*/
+static void clear_state(t_fooid *fid)
+{
+    memset(&(fid->fp), 0, sizeof(struct t_fingerprint));
+
+    fid->soundfound = 0;
+    fid->outpos = 0;
+    fid->framepos = 0;
+
+    /*
+        no frames analysed yet
+    */
+    fid->frames = 0;
+    fid->analysed = 0;
+    fid->total_dom = 0;
+    memset(fid->counts, 0, sizeof(fid->counts));
+    memset(fid->doms, 0, sizeof(fid->doms));
+}
+
+/*
+    set up resampling to 8000 Hz, common rates use
+    the polyphase decimator, anything else goes
+    through libresample; in exact mode only the
+    multiples of 8000 Hz use the decimator, as it
+    gives the same output as libresample there
+
+    output * TRUE on success
+*/
+static int open_resampler(t_fooid *fid)
+{
+    float *imp, *impd;
+
+    fid->resample_ratio = 8000.0f / (float)fid->samplerate;
+    fid->resample_h = NULL;
+    fid->poly = NULL;
+
+    if (!fid->exact_log || fid->samplerate % 8000 == 0) {
+        fid->poly = poly_open(fid->samplerate, &(fid->allocator));
+    }
+
+    if (fid->poly == NULL) {
+        if (get_lowpass(&imp, &impd) == 0) {
+            return FALSE;
+        }
+
+        fid->resample_h = resample_open_filter(FALSE, fid->resample_ratio, fid->resample_ratio,
+                                               imp, impd, fid->allocator.alloc,
+                                               fid->allocator.release, fid->allocator.ctx);
+
+        if (fid->resample_h == NULL) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
 
+static void close_resampler(t_fooid *fid)
+{
+    if (fid->poly != NULL) {
+        poly_close(fid->poly);
+    } else if (fid->resample_h != NULL) {
+        resample_close(fid->resample_h);
+    }
+
+    fid->poly = NULL;
+    fid->resample_h = NULL;
+}
 
 FOOIDAPI struct t_fooid* fp_init(int samplerate, int channels)
 {
-    t_fooid *res = (t_fooid*)malloc(sizeof(t_fooid));
+    return fp_init_allocator(samplerate, channels, NULL);
+}
+
+FOOIDAPI struct t_fooid* fp_init_allocator(int samplerate, int channels,
+                                           const fp_allocator *allocator)
+{
+    fp_allocator mem;
+    t_fooid *res;
+
+    /*
+        zeroed, so that fp_free can clean up
+        after a failure at any point
+    */
+    mem_set_allocator(&mem, allocator);
+    res = (t_fooid*)mem_calloc(&mem, 1, sizeof(t_fooid));
 
     if (res == NULL) {
         return NULL;
     }
 
-    memset(&(res->fp), 0, sizeof(struct t_fingerprint));
-    res->fp.version = FPVERSION;
+    res->allocator = mem;
+
+    clear_state(res);
 
     /*
         store input settings
     */
     res->channels = channels;
     res->samplerate = samplerate;
-    res->soundfound = 0;
-    res->outpos = 0;
 
     /*
         get Bark division & FFT window
     */
-    init_sine_window(res);
-    init_scales(res);
+    res->tables = get_frame_tables();
+#if defined(FOOID_EXACT_LOG)
+    res->exact_log = TRUE;
+#else
+    res->exact_log = FALSE;
+#endif
+
+    /*
+        serial analysis until asked otherwise
+    */
+    res->threads = 1;
+    res->executor = NULL;
+    res->executor_ctx = NULL;
+    res->frame_store = NULL;
+    res->thread_work = NULL;
 
     /*
-        get input buffer
+        get FFT tables and our own work buffer
     */
-    res->samples = (float *)calloc(SSIZE, sizeof(float));
-    res->sbuffer = (float *)malloc(sizeof(float) * IN_LEN);
+    res->fft_data = rfft_get_plan(FRAME_LEN);
+    res->fft_work = (t_complex *)mem_alloc_aligned(&mem, sizeof(t_complex) * SPEC_LEN);
 
-    if (res->samples == NULL || res->sbuffer == NULL) {
+    if (res->fft_data == NULL || res->fft_work == NULL) {
+        fp_free(res);
         return NULL;
     }
 
-     /*
-        set up resampling to 8000 Hz
+    /*
+        get input buffer, frames are analysed
+        as soon as they are complete
     */
-    res->resample_ratio = 8000.0f / (float)res->samplerate;
-    res->resample_h = resample_open(FALSE, res->resample_ratio, res->resample_ratio);
+    res->samples = (float *)mem_alloc_aligned(&mem, sizeof(float) * FRAME_LEN);
+    res->sbuffer = (float *)mem_alloc_aligned(&mem, sizeof(float) * IN_LEN);
+
+    if (res->samples == NULL || res->sbuffer == NULL) {
+        fp_free(res);
+        return NULL;
+    }
 
-    if (res->resample_h == NULL) {
+    memset(res->samples, 0, sizeof(float) * FRAME_LEN);
+
+    if (!open_resampler(res)) {
+        fp_free(res);
         return NULL;
     }
 
     return res;
 }
 
-FOOIDAPI int fp_feed_float(t_fooid * fid, float *data, int len)
+FOOIDAPI int fp_reset(t_fooid *fid, int samplerate, int channels)
+{
+    clear_state(fid);
+
+    fid->channels = channels;
+
+    /*
+        same rate: just drop the resampler history,
+        otherwise set it up again
+    */
+    if (samplerate == fid->samplerate) {
+        if (fid->poly != NULL) {
+            poly_reset(fid->poly);
+        } else {
+            resample_reset(fid->resample_h);
+        }
+        return 0;
+    }
+
+    close_resampler(fid);
+    fid->samplerate = samplerate;
+
+    if (!open_resampler(fid)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+    resample a chunk of mono samples into the analysis
+    frames, analysing every frame as soon as it is filled
+
+    output *  1  if more data should be fed
+              0  if all frames are done
+            < 0  on error
+*/
+static int feed_chunk(t_fooid *fid, float *in, int chunk)
 {
-    int pos;
-    int c;
-    float accum;
     int inpos;
     int res_out;
     int in_used;
 
+    inpos = 0;
+
+    while (inpos < chunk) {
+        if (fid->poly != NULL) {
+            res_out = poly_process(fid->poly,
+                                   &in[inpos], chunk - inpos, &in_used,
+                                   &(fid->samples[fid->framepos]), FRAME_LEN - fid->framepos);
+        } else {
+            res_out = resample_process(fid->resample_h, fid->resample_ratio,
+                                       &in[inpos], chunk - inpos, FALSE,
+                                       &in_used,
+                                       &(fid->samples[fid->framepos]), FRAME_LEN - fid->framepos);
+        }
+        if (res_out < 0) {
+            return -1;
+        }
+
+        fid->outpos   += res_out;
+        fid->framepos += res_out;
+        inpos         += in_used;
+
+        if (fid->framepos == FRAME_LEN) {
+            analyse_frame(fid);
+            fid->framepos = 0;
+
+            /*
+                are we done yet?
+            */
+            if (fid->frames >= ANFRAMES) {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+FOOIDAPI int fp_feed_float(t_fooid * fid, float *data, int len)
+{
+    int pos;
+    int chunk;
+    int res;
+
     /*
         check input validity
     */
@@ -101,26 +285,17 @@ FOOIDAPI int fp_feed_float(t_fooid * fid, float *data, int len)
     len = len / fid->channels;
 
     if (!fid->soundfound) {
-        pos = 0;
-
-        while (!fid->soundfound && pos < len) {
-            for (c = 0; c < fid->channels; c++) {
-                if (fabs(data[(pos * fid->channels) + c]) >= (1.0f/32768.0f - EPSILON)) {
-                    fid->soundfound = TRUE;
-                }
-            }
-            if (!fid->soundfound) {
-                pos++;
-            }
-        }
+        pos = sound_start_float(data, len, fid->channels);
 
         /*
             end without sound?
         */
-        if (pos >= len && !fid->soundfound) {
+        if (pos >= len) {
             return TRUE;
         }
 
+        fid->soundfound = TRUE;
+
         /*
             adjust start
         */
@@ -131,88 +306,196 @@ FOOIDAPI int fp_feed_float(t_fooid * fid, float *data, int len)
     /*
         silly user feeding us more than we need?
     */
-    if (fid->outpos >= SSIZE) {
+    if (fid->frames >= ANFRAMES) {
         return FALSE;
     }
 
+    /*
+        mono input needs no downmix, resample
+        straight from the caller's buffer
+    */
+    if (fid->channels == 1) {
+        return feed_chunk(fid, data, len);
+    }
+
     /*
         now we have music data queued up
         process it at most IN_LEN at a time
     */
     do {
-        /*
-            read samples
-        */
-        for (pos = 0; pos < len && pos < IN_LEN; pos++) {
-            /*
-                downmix sample
-            */
-            accum = 0;
-            for (c = 0; c < fid->channels; c++) {
-                accum += data[(pos * fid->channels) + c];
-            }
-            accum /= (float)fid->channels;
+        chunk = min_int(len, IN_LEN);
 
-            fid->sbuffer[pos] = accum;
-        }
+        downmix_float(data, chunk, fid->channels, fid->sbuffer);
 
-        inpos = 0;
+        res = feed_chunk(fid, fid->sbuffer, chunk);
+        if (res <= 0) {
+            return res;
+        }
 
         /*
-            feed to resampler
+            check if there's still input left
         */
-        do {
-            res_out = resample_process(fid->resample_h, fid->resample_ratio,
-                                       &(fid->sbuffer[inpos]), min(IN_LEN - inpos, len), FALSE,
-                                       &in_used,
-                                       &(fid->samples[fid->outpos]), SSIZE - fid->outpos);
-            fid->outpos += res_out;
-            inpos       += in_used;
-        } while (in_used < min(IN_LEN, len) && fid->outpos < SSIZE);
+        len  = len - chunk;
+        data = data + (chunk * fid->channels);
+    } while (len > 0);
+
+    return TRUE;
+}
+
+FOOIDAPI int fp_feed_short(t_fooid *fid, short *data, int len)
+{
+    int pos;
+    int chunk;
+    int res;
+
+    /*
+        check input validity
+    */
+    if (len % fid->channels != 0) {
+        return -1;
+    }
+
+    len = len / fid->channels;
+
+    if (!fid->soundfound) {
+        pos = sound_start_short(data, len, fid->channels);
 
         /*
-            are we done yet?
+            end without sound?
         */
-        if (fid->outpos >= SSIZE) {
-            return FALSE;
+        if (pos >= len) {
+            return TRUE;
         }
 
+        fid->soundfound = TRUE;
+
         /*
-            check if there's still input left
+            adjust start
         */
-        len  = len - in_used;
-        data = data + (in_used * fid->channels);
+        len  = len - pos;
+        data = data + (pos * fid->channels);
+    }
+
+    /*
+        silly user feeding us more than we need?
+    */
+    if (fid->frames >= ANFRAMES) {
+        return FALSE;
+    }
+
+    /*
+        convert and downmix straight into sbuffer,
+        at most IN_LEN at a time
+    */
+    do {
+        chunk = min_int(len, IN_LEN);
+
+        downmix_short(data, chunk, fid->channels, fid->sbuffer);
+
+        res = feed_chunk(fid, fid->sbuffer, chunk);
+        if (res <= 0) {
+            return res;
+        }
+
+        len  = len - chunk;
+        data = data + (chunk * fid->channels);
     } while (len > 0);
 
     return TRUE;
 }
 
-FOOIDAPI  int fp_feed_short(t_fooid *fid, short *data, int len)
+FOOIDAPI int fp_set_exact_log(t_fooid *fi, int exact)
 {
-    int res;
-    int i;
-    float *buff;
+#if defined(FOOID_EXACT_LOG)
+    if (!exact) {
+        return -1;
+    }
+#endif
 
-    buff = (float*)malloc(sizeof(float) * len * fid->channels);
+    exact = exact ? TRUE : FALSE;
 
-    if (buff == NULL) {
-        return FALSE;
+    if (exact == fi->exact_log) {
+        return 0;
     }
 
-    for (i = 0; i < len * fid->channels; i++) {
-        buff[i] = data[i] / 32767.0f;
+    /*
+        the resampler depends on the mode as well
+    */
+    close_resampler(fi);
+    fi->exact_log = exact;
+
+    if (!open_resampler(fi)) {
+        return -1;
     }
 
-    res = fp_feed_float(fid, buff, len);
+    return 0;
+}
 
-    free(buff);
+/*
+    choose between analysing frames as they come
+    in, or keeping them for fp_calculate, done by
+    threads tasks
 
-    return res;
+    output *   0 on success
+             < 0 on error
+*/
+static int set_analysis(t_fooid *fi, const int keep, int threads,
+                        fp_executor_func executor, void *ctx)
+{
+    if (fi->outpos > 0) {
+        return -1;
+    }
+
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > ANFRAMES) {
+        threads = ANFRAMES;
+    }
+
+    mem_free_aligned(&(fi->allocator), fi->frame_store);
+    mem_free_aligned(&(fi->allocator), fi->thread_work);
+    fi->frame_store = NULL;
+    fi->thread_work = NULL;
+    fi->threads = 1;
+    fi->executor = NULL;
+    fi->executor_ctx = NULL;
+
+    if (!keep) {
+        return 0;
+    }
+
+    fi->frame_store = (float *)mem_alloc_aligned(&(fi->allocator), sizeof(float) * FRAME_LEN * ANFRAMES);
+    fi->thread_work = (t_complex *)mem_alloc_aligned(&(fi->allocator), sizeof(t_complex) * SPEC_LEN * threads);
+
+    if (fi->frame_store == NULL || fi->thread_work == NULL) {
+        mem_free_aligned(&(fi->allocator), fi->frame_store);
+        mem_free_aligned(&(fi->allocator), fi->thread_work);
+        fi->frame_store = NULL;
+        fi->thread_work = NULL;
+        return -1;
+    }
+
+    fi->threads = threads;
+    fi->executor = executor;
+    fi->executor_ctx = ctx;
+
+    return 0;
+}
+
+FOOIDAPI int fp_set_threads(t_fooid *fi, int threads,
+                            fp_executor_func executor, void *ctx)
+{
+    return set_analysis(fi, threads > 1, threads, executor, ctx);
 }
 
 FOOIDAPI int fp_getversion(t_fooid *fi)
 {
-    return FPVERSION;
+    if (fi == NULL) {
+        return FPVERSION;
+    }
+
+    return fi->exact_log ? FPVERSION_EXACT : FPVERSION;
 }
 
 FOOIDAPI int fp_getsize(t_fooid *fi)
@@ -229,6 +512,7 @@ FOOIDAPI int fp_calculate(t_fooid *fi, int songlen, unsigned char* buff)
         return -1;
     }
 
+    fi->fp.version = (short)fp_getversion(fi);
     fi->fp.length = songlen;
     get_params(fi);
 
@@ -255,8 +539,16 @@ FOOIDAPI int fp_calculate(t_fooid *fi, int songlen, unsigned char* buff)
 
 FOOIDAPI void fp_free(t_fooid * fid)
 {
-    resample_close(fid->resample_h);
-    free(fid->sbuffer);
-    free(fid->samples);
-    free(fid);
+    /*
+        the handle holds its allocator
+    */
+    fp_allocator mem = fid->allocator;
+
+    close_resampler(fid);
+    mem_free_aligned(&mem, fid->sbuffer);
+    mem_free_aligned(&mem, fid->samples);
+    mem_free_aligned(&mem, fid->fft_work);
+    mem_free_aligned(&mem, fid->frame_store);
+    mem_free_aligned(&mem, fid->thread_work);
+    mem_free(&mem, fid);
 }
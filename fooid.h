@@ -30,8 +30,45 @@ extern "C" {
 #define FOOIDAPI
 #endif
 
+#include <stddef.h>
+
+/*
+    Size of a packed fingerprint, as written by
+    fp_calculate, and where its fields are. The
+    spectral fits take FP_R_FRAME bytes per frame,
+    2 bits a band, and the dominant lines 6 bits a
+    frame, both first frame first and highest bits
+    first.
+*/
+#define FP_SIZE            424
+#define FP_LENGTH_OFFSET     2
+#define FP_FIT_OFFSET        6
+#define FP_AVGDOM_OFFSET     8
+#define FP_R_OFFSET         10
+#define FP_R_BYTES         348
+#define FP_R_FRAME           4
+#define FP_DOM_OFFSET      358
+#define FP_DOM_BYTES        66
+#define FP_FRAMES           87
+
 typedef struct t_fooid t_fooid;
 
+/*
+    Allocator hooks, see fp_init_allocator.
+*/
+typedef void* (*fp_alloc_func)(void *ctx, size_t size);
+typedef void (*fp_release_func)(void *ctx, void *ptr);
+typedef void* (*fp_aligned_alloc_func)(void *ctx, size_t size, size_t alignment);
+
+typedef struct
+{
+    fp_alloc_func alloc;
+    fp_release_func release;
+    fp_aligned_alloc_func aligned_alloc;    /* may be NULL */
+    void *ctx;
+}
+fp_allocator;
+
 /*
     Set up library for generating fingerprints for
     file with a given sampling rate and number of
@@ -46,11 +83,116 @@ typedef struct t_fooid t_fooid;
 */
 FOOIDAPI t_fooid * fp_init(int samplerate, int channels);
 
+/*
+    Same as fp_init, with all the memory of the
+    handle and its resampler coming from your own
+    allocator. Sample and FFT buffers are aligned
+    to 64 bytes, through the aligned allocation
+    function if there is one, otherwise by padding
+    blocks from the plain one. The release function
+    gets blocks from both. All three receive ctx.
+
+    The allocator is copied into the handle, so
+    handles with different allocators can be used
+    side by side. Tables shared by all handles (FFT,
+    window, filters) are built once on first use
+    with the system allocator and live as long as
+    the process.
+
+    input  * sampling rate in Hz
+           * number of channels
+           * allocator, NULL or one without alloc
+             or release for malloc and free
+
+    output * handle to fingerprinter
+             (NULL on error)
+*/
+FOOIDAPI t_fooid * fp_init_allocator(int samplerate, int channels,
+                                     const fp_allocator *allocator);
+
 /*
     Free a fingerprinter handle.
 */
 FOOIDAPI void fp_free(t_fooid * fid);
 
+/*
+    Reuse a fingerprinter handle for another file,
+    as if it had been freed and set up again with
+    fp_init. Buffers are kept, and so is the
+    resampler when the sampling rate is unchanged.
+
+    input  * fingerprinter handle
+           * sampling rate in Hz
+           * number of channels
+
+    output *   0 on success
+             < 0 on error, the handle can only be freed
+*/
+FOOIDAPI int fp_reset(t_fooid * fid, int samplerate, int channels);
+
+/*
+    Choose between fast and exact fingerprinting.
+    By default the power spectrum is taken to dB
+    with a vectorized log, within 3.1e-5 dB of the
+    C library log, and 44100 Hz and the other
+    common rates are resampled with a polyphase
+    decimator, more accurate than libresample.
+    Both change some spectral fits, so these are
+    version 1 fingerprints. Exact mode uses the C
+    library log and libresample, and gives the same
+    version 0 fingerprints as earlier versions.
+    Builds with FOOID_EXACT_LOG always use it.
+    Call it before feeding a song; the setting is
+    kept by fp_reset.
+
+    input  * fingerprinter handle
+           * nonzero for exact mode
+
+    output *   0 on success
+             < 0 if fast mode was asked for but
+                 the fast log is not built in, or
+                 on error, when the handle can
+                 only be freed
+*/
+FOOIDAPI int fp_set_exact_log(t_fooid *fi, int exact);
+
+/*
+    Executors for fp_set_threads: run task(arg, index)
+    for every index from 0 to count - 1, concurrently
+    if possible, and return when all have finished.
+*/
+typedef void (*fp_task_func)(void *arg, int index);
+typedef void (*fp_executor_func)(void *ctx, fp_task_func task, void *arg, int count);
+
+/*
+    Analyse the frames of a fingerprint in parallel,
+    to get a single fingerprint out sooner. Frames are
+    then kept as they are fed (about 2.8 MB) instead of
+    analysed right away, and fp_calculate splits them
+    into up to threads parts, each with its own FFT
+    buffer. The parts run on threads started for the
+    call, no more than the processor has cores, or
+    through executor if you pass one; to keep the
+    threads from one call to the next, pass an
+    executor that runs the tasks on a pool. The
+    fingerprint is the same as with serial analysis.
+
+    Call this before feeding any data. One thread or
+    less goes back to serial analysis. The setting is
+    kept by fp_reset.
+
+    input  * fingerprinter handle
+           * number of parts
+           * executor, NULL for our own threads
+           * context for the executor
+
+    output *   0 on success
+             < 0 on error, data was already fed
+                 or out of memory
+*/
+FOOIDAPI int fp_set_threads(t_fooid *fi, int threads,
+                            fp_executor_func executor, void *ctx);
+
 /*
     Feed a buffer of samples to the fingerprinting
     generator. The sample buffer size should be a
@@ -88,9 +230,12 @@ FOOIDAPI int fp_getsize(t_fooid *fi);
 
 /*
     Returns the fingerprint version number that
-    this library will generate
+    a handle will generate: 1, or 0 in exact mode,
+    see fp_set_exact_log. Fingerprints of
+    different versions do not match.
 
-    input  * fingerprinter handle
+    input  * fingerprinter handle, or NULL for
+             the version made by default
 
     output * version number
 */
@@ -114,6 +259,267 @@ FOOIDAPI int fp_getversion(t_fooid *fi);
 */
 FOOIDAPI int fp_calculate(t_fooid *fi, int songlen, unsigned char* buff);
 
+/*
+    Compare two fingerprints made by fp_calculate.
+    The distance weighs how far the spectral fits
+    are apart (half), how many dominant lines
+    differ, and the difference in length, average
+    fit and average dominant line. Fingerprints of
+    different versions are as far apart as can be.
+
+    input  * fingerprint
+           * fingerprint
+
+    output * distance, from 0 for identical
+             fingerprints to 1
+*/
+FOOIDAPI float fp_compare(const unsigned char *fp1, const unsigned char *fp2);
+
+/*
+    As fp_compare, but for songs that do not start
+    at the same point, such as a radio edit with a
+    shorter intro. Every shift of up to max_shift
+    frames, of about a second each, is scored over
+    the frames that overlap there, and the distance
+    is that of the best one, the nearest shift on
+    a tie. Shift 0 gives the distance of fp_compare,
+    so the distance is never more than that.
+    Shifts are scored in order of how many dominant
+    lines match, and each stops as soon as it
+    cannot beat the best so far.
+
+    input  * fingerprint
+           * fingerprint
+           * largest shift to try, at most 43
+           * the best shift, frame i of the first
+             lining up with frame i + shift of the
+             second, may be NULL
+
+    output * distance, from 0 for identical
+             fingerprints to 1
+*/
+FOOIDAPI float fp_compare_shifted(const unsigned char *fp1, const unsigned char *fp2,
+                                  int max_shift, int *shift);
+
+/*
+    Score a fingerprint against an array of them,
+    by the distance between their spectral fits
+    alone: the sum over all fits of how far they
+    are apart, from 0 to 4176. This is the part of
+    fp_compare that weighs most, scaled.
+
+    The fingerprints can be part of larger records,
+    stride bytes apart.
+
+    input  * fingerprint to look for
+           * first fingerprint of the array
+           * number of fingerprints
+           * bytes from one fingerprint to the next,
+             0 for fp_getsize
+           * a score for each fingerprint
+
+    output *   0 on success
+             < 0 on error
+*/
+FOOIDAPI int fp_scan(const unsigned char *query, const unsigned char *base,
+                     int count, int stride, int *scores);
+
+/*
+    As fp_scan, but only give the k best, with the
+    lowest score first, and the earlier fingerprint
+    first on a tie. Fingerprints stop being scored
+    once they score worse than the k best so far,
+    which makes this much faster than fp_scan.
+
+    input  * fingerprint to look for
+           * first fingerprint of the array
+           * number of fingerprints
+           * bytes from one fingerprint to the next,
+             0 for fp_getsize
+           * number of best fingerprints wanted
+           * the index of each in the array
+           * the score of each
+
+    output * number of fingerprints given, k or
+             fewer if the array is smaller
+             < 0 on error
+*/
+FOOIDAPI int fp_scan_topk(const unsigned char *query, const unsigned char *base,
+                          int count, int stride, int k, int *ids, int *scores);
+
+/*
+    Nearest neighbour index over many fingerprints,
+    for when there are too many to scan each time.
+    Fingerprints that hash like the query on their
+    spectral fits are found through a few tables of
+    hash buckets, and only those are scored, by the
+    distance of fp_compare. A fingerprint far from
+    all its near neighbours' buckets can be missed,
+    trading a little recall for speed; see
+    fp_index_set_probes.
+*/
+typedef struct t_fp_index t_fp_index;
+
+/*
+    Build an index over an array of fingerprints.
+    The index takes 85 to 120 bytes per fingerprint,
+    and keeps a pointer to the array rather than a
+    copy, so the array must be kept, unchanged,
+    until the index is freed.
+
+    input  * first fingerprint of the array
+           * id of each fingerprint, NULL to use
+             the index in the array
+           * number of fingerprints
+           * bytes from one fingerprint to the next,
+             0 for fp_getsize
+
+    output * index
+             (NULL on error)
+*/
+FOOIDAPI t_fp_index * fp_index_build(const unsigned char *fps, const int *ids,
+                                     int count, int stride);
+
+/*
+    Find the k fingerprints nearest to a query, with
+    the nearest first, and the earlier fingerprint in
+    the array first on a tie. Several threads can
+    query the same index at once.
+
+    input  * index
+           * fingerprint to look for
+           * number of fingerprints wanted
+           * the id of each
+           * the distance of each, as fp_compare
+
+    output * number of fingerprints given, k or
+             fewer if fewer were found
+             < 0 on error
+*/
+FOOIDAPI int fp_index_query(const t_fp_index *index, const unsigned char *query,
+                            int k, int *ids, float *distances);
+
+/*
+    Set how many buckets a query looks in per table,
+    32 by default, up to 79. More find more of the
+    near neighbours, and take longer.
+
+    output *   0 on success
+             < 0 on error
+*/
+FOOIDAPI int fp_index_set_probes(t_fp_index *index, int probes);
+
+/*
+    Only look for fingerprints whose header is close
+    to that of the query. Those further off in length,
+    average fit or average dominant line are passed
+    over before any is compared, and when the lengths
+    allowed take in few enough fingerprints, all of
+    those within the tolerances are compared, so none
+    is missed. No limit is set at first.
+
+    input  * index
+           * largest difference in length, in
+             centiseconds, negative for no limit
+           * largest difference in average fit, in
+             thousandths, negative for no limit
+           * largest difference in average dominant
+             line, in hundredths, negative for no limit
+
+    output *   0 on success
+             < 0 on error
+*/
+FOOIDAPI int fp_index_set_tolerances(t_fp_index *index, int length,
+                                     int avg_fit, int avg_dom);
+
+/*
+    Free an index. The fingerprints are not freed.
+*/
+FOOIDAPI void fp_index_free(t_fp_index *index);
+
+/*
+    Batch fingerprinting.
+
+    A batch holds a number of worker threads, each with
+    a fingerprinter handle that is reused from one song
+    to the next, so FFT buffers and resamplers stay warm.
+    Songs are shared out between the workers, and idle
+    workers take over songs queued at busy ones.
+*/
+typedef struct t_fp_batch t_fp_batch;
+
+/*
+    Feed a song to a handle, with fp_feed_short or
+    fp_feed_float, for songs that are not in memory.
+
+    input  * the item's user pointer
+           * handle, set up for the item's sampling
+             rate and number of channels
+
+    output * total length of song in centiseconds
+             < 0 on error
+*/
+typedef int (*fp_feeder_func)(void *user, t_fooid *fi);
+
+typedef struct
+{
+    /*
+        input, the song is either a buffer of
+        interleaved shorts or floats, or comes
+        from a feeder
+    */
+    int samplerate;
+    int channels;
+    short *shorts;
+    float *floats;
+    int size;
+    fp_feeder_func feeder;
+    void *user;
+    /*
+        total length of song in centiseconds,
+        0 to take it from the buffer or feeder
+    */
+    int songlen;
+
+    /*
+        output, fingerprint and 0 on success,
+        < 0 on error
+    */
+    unsigned char fingerprint[FP_SIZE];
+    int result;
+}
+fp_batch_item;
+
+/*
+    Set up a batch.
+
+    input  * number of worker threads
+
+    output * batch handle
+             (NULL on error)
+*/
+FOOIDAPI t_fp_batch * fp_batch_init(int threads);
+
+/*
+    Fingerprint a number of songs. A failing song
+    only sets its own result, the others go on.
+    The feeders of different items may run at the
+    same time, on different threads.
+
+    input  * batch handle
+           * songs
+           * number of songs
+
+    output * number of songs that failed
+             < 0 if the batch could not run
+*/
+FOOIDAPI int fp_batch_run(t_fp_batch *batch, fp_batch_item *items, int count);
+
+/*
+    Free a batch and its handles.
+*/
+FOOIDAPI void fp_batch_free(t_fp_batch *batch);
+
 
 #if defined(__cplusplus)
 } // extern "C"
@@ -52,23 +52,20 @@ static const int quantize_harmonic(const float dom)
     return 63;
 }
 
-void get_dominant_harmonic(const t_complex *data, int *idom)
+/*
+    quantize the frequency of every spectral line,
+    a frame's dominant harmonic is then just the
+    entry of its strongest line
+
+    output * SPEC_LEN codes
+*/
+void init_dom_codes(unsigned char *dom_code)
 {
     int i;
-    int maxid = 0;
-    float pwr;
-    float maxpwr = 0.0f;
     float dom;
 
     for (i = 0; i < SPEC_LEN; i++) {
-        pwr = data[i].re * data[i].re + data[i].im * data[i].im;
-
-        if (pwr > maxpwr) {
-            maxpwr = pwr;
-            maxid = i;
-        }
+        dom = 4000.0f * ((float)i / SPEC_LEN);
+        dom_code[i] = (unsigned char)quantize_harmonic(dom);
     }
-
-    dom = 4000.0f * ((float)maxid / SPEC_LEN);
-    *idom = quantize_harmonic(dom);
 }
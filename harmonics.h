@@ -17,8 +17,6 @@
 #ifndef HARMONIC_H
 #define HARMONIC_H
 
-#include "s_fft.h"
-
-void get_dominant_harmonic(const t_complex *data, int *idom);
+void init_dom_codes(unsigned char *dom_code);
 
 #endif
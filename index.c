@@ -0,0 +1,743 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+
+/*
+    Nearest neighbour search over many fingerprints.
+
+    The spectral fits are 2-bit codes, and the distance
+    between two codes is how many of the thresholds 1, 2
+    and 3 lie between them. So if a hash key is made of
+    threshold bits, code >= t for some code and some t,
+    fingerprints at a small distance mostly get the same
+    key and unrelated ones mostly do not.
+
+    Each table takes its own bits for its key, at random
+    from those that split the fingerprints most evenly,
+    and keeps the fingerprints ordered by key. A query
+    looks in the bucket of its own key in every table,
+    and in those of the keys it gets when the bits that
+    are nearest to flipping are flipped, and scores what
+    it finds there with the distance of fp_compare.
+
+    The length, average fit and average dominant line
+    of every fingerprint are also kept, in columns in
+    order of length. With tolerances on them set, the
+    fingerprints outside are dropped before any is
+    scored, and when the lengths in tolerance take in
+    fewer fingerprints than the buckets, those are all
+    scored instead.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "compare.h"
+
+#define INDEX_TABLES    8
+
+/*
+    bits in a key, about one key for every
+    fingerprint
+*/
+#define MIN_KEY_BITS    8
+#define MAX_KEY_BITS    24
+#define BUCKET_SIZE     1
+
+/*
+    probes per table, in the bucket of the key and
+    those with one or two of the bits nearest to
+    flipping flipped
+*/
+#define DEFAULT_PROBES  32
+#define FLIP_BITS       12
+#define MAX_PROBES      (1 + FLIP_BITS + FLIP_BITS * (FLIP_BITS - 1) / 2)
+
+/*
+    how many fingerprints the bits are picked on
+*/
+#define SAMPLE          16384
+
+/*
+    how many candidates ahead to prefetch
+*/
+#define AHEAD           4
+
+struct t_fp_index
+{
+    const unsigned char *base;
+    int count;
+    int stride;
+    int *ids;
+
+    int bits;
+    int probes;
+
+    /*
+        per table, the code and threshold of each
+        bit of the key, lowest bit first
+    */
+    unsigned short code[INDEX_TABLES][MAX_KEY_BITS];
+    unsigned char threshold[INDEX_TABLES][MAX_KEY_BITS];
+
+    /*
+        per table, the fingerprints in order of key,
+        those with key k from start[k] to start[k + 1] - 1
+    */
+    unsigned int *start[INDEX_TABLES];
+    unsigned int *entries[INDEX_TABLES];
+
+    /*
+        the header of each fingerprint, in order of
+        length, and where each fingerprint of the
+        array is in that order
+    */
+    int *length;
+    short *fit;
+    short *avgdom;
+    int *position;
+    int *rank;
+
+    /*
+        the largest difference to the query kept,
+        negative for no limit
+    */
+    int length_tolerance;
+    int fit_tolerance;
+    int avgdom_tolerance;
+};
+
+static int get_code(const unsigned char *r, const int i)
+{
+    return (r[i >> 2] >> (6 - 2 * (i & 3))) & 3;
+}
+
+static unsigned int get_key(const t_fp_index *index, const int table, const unsigned char *r)
+{
+    unsigned int key = 0;
+    int i;
+
+    for (i = 0; i < index->bits; i++) {
+        key |= (unsigned int)(get_code(r, index->code[table][i])
+                              >= index->threshold[table][i]) << i;
+    }
+
+    return key;
+}
+
+static unsigned int next_random(unsigned int *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+
+    return *seed >> 8;
+}
+
+/*
+    count how often each threshold bit is set over a
+    sample of the fingerprints, and give each table
+    bits from those that are set for close to half
+*/
+static int pick_bits(t_fp_index *index)
+{
+    const int step = index->count / SAMPLE + 1;
+    const int bits = 3 * R_CODES;
+    int *ones = (int *)mem_calloc(NULL, bits, sizeof(int));
+    int *pool = (int *)mem_alloc(NULL, sizeof(int) * bits);
+    unsigned int seed = 1;
+    int sampled = 0, pooled = 0;
+    int i, j, t, least, bit;
+
+    if (ones == NULL || pool == NULL) {
+        mem_free(NULL, ones);
+        mem_free(NULL, pool);
+        return -1;
+    }
+
+    for (i = 0; i < index->count; i += step) {
+        const unsigned char *r = index->base + (size_t)i * index->stride + FP_R_OFFSET;
+
+        for (j = 0; j < R_CODES; j++) {
+            for (t = 1; t <= get_code(r, j); t++) {
+                ones[3 * j + t - 1]++;
+            }
+        }
+        sampled++;
+    }
+
+    /*
+        the bits set for a quarter to three quarters of
+        the fingerprints, or if there are too few of
+        those, the most even ones there are
+    */
+    for (least = sampled / 4; least >= 0; least = least > 0 ? least / 2 : -1) {
+        pooled = 0;
+
+        for (i = 0; i < bits; i++) {
+            if (ones[i] >= least && sampled - ones[i] >= least) {
+                pool[pooled++] = i;
+            }
+        }
+
+        if (pooled >= INDEX_TABLES * index->bits) {
+            break;
+        }
+    }
+
+    for (t = 0; t < INDEX_TABLES; t++) {
+        for (i = 0; i < index->bits; i++) {
+            j = i + (int)(next_random(&seed) % (unsigned int)(pooled - i));
+            bit = pool[j];
+            pool[j] = pool[i];
+            pool[i] = bit;
+
+            index->code[t][i] = (unsigned short)(pool[i] / 3);
+            index->threshold[t][i] = (unsigned char)(pool[i] % 3 + 1);
+        }
+    }
+
+    mem_free(NULL, ones);
+    mem_free(NULL, pool);
+
+    return 0;
+}
+
+/*
+    sort the fingerprints of a table by key, by
+    counting them per key first
+*/
+static int fill_table(t_fp_index *index, const int table, unsigned int *keys)
+{
+    const unsigned int size = 1u << index->bits;
+    unsigned int *start, *entries;
+    unsigned int k, sum, n;
+    int i;
+
+    start = (unsigned int *)mem_calloc(NULL, size + 1, sizeof(unsigned int));
+    entries = (unsigned int *)mem_alloc(NULL, sizeof(unsigned int) * (index->count > 0 ? index->count : 1));
+    index->start[table] = start;
+    index->entries[table] = entries;
+
+    if (start == NULL || entries == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < index->count; i++) {
+        keys[i] = get_key(index, table,
+                          index->base + (size_t)i * index->stride + FP_R_OFFSET);
+        start[keys[i]]++;
+    }
+
+    for (k = 0, sum = 0; k <= size; k++) {
+        n = start[k];
+        start[k] = sum;
+        sum += n;
+    }
+
+    /*
+        start[k] moves on to the start of k + 1
+        as the bucket of k fills up
+    */
+    for (i = 0; i < index->count; i++) {
+        entries[start[keys[i]]++] = (unsigned int)i;
+    }
+
+    for (k = size; k > 0; k--) {
+        start[k] = start[k - 1];
+    }
+    start[0] = 0;
+
+    return 0;
+}
+
+/*
+    sort the headers by length, on keys of the length,
+    with the sign bit flipped so that it sorts as
+    unsigned, over the position
+*/
+static int compare_keys(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int fill_columns(t_fp_index *index)
+{
+    const int n = index->count > 0 ? index->count : 1;
+    unsigned long long *keys;
+    int i, p;
+
+    index->length = (int *)mem_alloc(NULL, sizeof(int) * n);
+    index->fit = (short *)mem_alloc(NULL, sizeof(short) * n);
+    index->avgdom = (short *)mem_alloc(NULL, sizeof(short) * n);
+    index->position = (int *)mem_alloc(NULL, sizeof(int) * n);
+    index->rank = (int *)mem_alloc(NULL, sizeof(int) * n);
+    keys = (unsigned long long *)mem_alloc(NULL, sizeof(unsigned long long) * n);
+
+    if (index->length == NULL || index->fit == NULL || index->avgdom == NULL
+        || index->position == NULL || index->rank == NULL || keys == NULL) {
+        mem_free(NULL, keys);
+        return -1;
+    }
+
+    for (i = 0; i < index->count; i++) {
+        unsigned int length = (unsigned int)get_int(index->base + (size_t)i * index->stride,
+                                                    FP_LENGTH_OFFSET);
+
+        keys[i] = (unsigned long long)(length ^ 0x80000000u) << 32 | (unsigned int)i;
+    }
+
+    qsort(keys, index->count, sizeof(unsigned long long), compare_keys);
+
+    for (i = 0; i < index->count; i++) {
+        const unsigned char *fp;
+
+        p = (int)(keys[i] & 0xFFFFFFFFu);
+        fp = index->base + (size_t)p * index->stride;
+
+        index->length[i] = get_int(fp, FP_LENGTH_OFFSET);
+        index->fit[i] = (short)get_short(fp, FP_FIT_OFFSET);
+        index->avgdom[i] = (short)get_short(fp, FP_AVGDOM_OFFSET);
+        index->position[i] = p;
+        index->rank[p] = i;
+    }
+
+    mem_free(NULL, keys);
+
+    return 0;
+}
+
+FOOIDAPI t_fp_index * fp_index_build(const unsigned char *fps, const int *ids,
+                                     int count, int stride)
+{
+    t_fp_index *index;
+    unsigned int *keys;
+    int i;
+
+    if (stride == 0) {
+        stride = FPSIZE;
+    }
+
+    if (count < 0 || (count > 0 && fps == NULL) || stride < FPSIZE) {
+        return NULL;
+    }
+
+    index = (t_fp_index *)mem_calloc(NULL, 1, sizeof(t_fp_index));
+
+    if (index == NULL) {
+        return NULL;
+    }
+
+    index->base = fps;
+    index->count = count;
+    index->stride = stride;
+    index->probes = DEFAULT_PROBES;
+    index->length_tolerance = -1;
+    index->fit_tolerance = -1;
+    index->avgdom_tolerance = -1;
+
+    index->bits = bitlen(count / BUCKET_SIZE);
+    if (index->bits < MIN_KEY_BITS) {
+        index->bits = MIN_KEY_BITS;
+    }
+    if (index->bits > MAX_KEY_BITS) {
+        index->bits = MAX_KEY_BITS;
+    }
+
+    index->ids = (int *)mem_alloc(NULL, sizeof(int) * (count > 0 ? count : 1));
+    keys = (unsigned int *)mem_alloc(NULL, sizeof(unsigned int) * (count > 0 ? count : 1));
+
+    if (index->ids == NULL || keys == NULL
+        || pick_bits(index) < 0 || fill_columns(index) < 0) {
+        mem_free(NULL, keys);
+        fp_index_free(index);
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        index->ids[i] = ids != NULL ? ids[i] : i;
+    }
+
+    for (i = 0; i < INDEX_TABLES; i++) {
+        if (fill_table(index, i, keys) < 0) {
+            mem_free(NULL, keys);
+            fp_index_free(index);
+            return NULL;
+        }
+    }
+
+    mem_free(NULL, keys);
+
+    return index;
+}
+
+FOOIDAPI int fp_index_set_probes(t_fp_index *index, int probes)
+{
+    if (index == NULL || probes < 1) {
+        return -1;
+    }
+
+    index->probes = probes < MAX_PROBES ? probes : MAX_PROBES;
+
+    return 0;
+}
+
+FOOIDAPI int fp_index_set_tolerances(t_fp_index *index, int length,
+                                     int avg_fit, int avg_dom)
+{
+    if (index == NULL) {
+        return -1;
+    }
+
+    index->length_tolerance = length < 0 ? -1 : length;
+    index->fit_tolerance = avg_fit < 0 ? -1 : avg_fit;
+    index->avgdom_tolerance = avg_dom < 0 ? -1 : avg_dom;
+
+    return 0;
+}
+
+FOOIDAPI void fp_index_free(t_fp_index *index)
+{
+    int i;
+
+    if (index == NULL) {
+        return;
+    }
+
+    for (i = 0; i < INDEX_TABLES; i++) {
+        mem_free(NULL, index->start[i]);
+        mem_free(NULL, index->entries[i]);
+    }
+    mem_free(NULL, index->length);
+    mem_free(NULL, index->fit);
+    mem_free(NULL, index->avgdom);
+    mem_free(NULL, index->position);
+    mem_free(NULL, index->rank);
+    mem_free(NULL, index->ids);
+    mem_free(NULL, index);
+}
+
+/*
+    the keys to look up in a table, that of the query
+    first, then those with the bits flipped that take
+    the least change in the codes to flip, one or two
+    at a time
+
+    output * number of keys
+*/
+static int get_probes(const t_fp_index *index, const int table,
+                      const unsigned char *r, unsigned int *keys)
+{
+    int margin[MAX_KEY_BITS], order[MAX_KEY_BITS];
+    int cost[MAX_PROBES];
+    unsigned int flip[MAX_PROBES];
+    unsigned int key = 0;
+    int flips = 0;
+    int code, t, n;
+    int i, j;
+
+    for (i = 0; i < index->bits; i++) {
+        code = get_code(r, index->code[table][i]);
+        t = index->threshold[table][i];
+
+        if (code >= t) {
+            key |= 1u << i;
+            margin[i] = code - t + 1;
+        } else {
+            margin[i] = t - code;
+        }
+
+        for (j = i; j > 0 && margin[i] < margin[order[j - 1]]; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    /*
+        one or two of the bits nearest to flipping,
+        cheapest first, for as many as are wanted
+    */
+    n = index->bits < FLIP_BITS ? index->bits : FLIP_BITS;
+
+    for (i = 0; i < n; i++) {
+        for (j = i; j < n; j++) {
+            int c = j == i ? margin[order[i]] : margin[order[i]] + margin[order[j]];
+            int m;
+
+            for (m = flips; m > 0 && c < cost[m - 1]; m--) {
+                cost[m] = cost[m - 1];
+                flip[m] = flip[m - 1];
+            }
+            cost[m] = c;
+            flip[m] = (1u << order[i]) | (1u << order[j]);
+            flips++;
+        }
+    }
+
+    keys[0] = key;
+
+    for (i = 1; i < index->probes && i <= flips; i++) {
+        keys[i] = key ^ flip[i - 1];
+    }
+
+    return i;
+}
+
+static int compare_positions(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+    distances are never negative, so their bits
+    order like ints, and the k best can be kept
+    in the same heap as the scores of fp_scan_topk
+*/
+static int distance_key(const float dist)
+{
+    int key;
+
+    memcpy(&key, &dist, sizeof(key));
+
+    return key;
+}
+
+static float key_distance(const int key)
+{
+    float dist;
+
+    memcpy(&dist, &key, sizeof(dist));
+
+    return dist;
+}
+
+static void prefetch_fp(const unsigned char *fp)
+{
+    int i;
+
+    for (i = 0; i < FPSIZE; i += CACHE_LINE) {
+        PREFETCH(fp + i);
+    }
+    PREFETCH(fp + FPSIZE - 1);
+}
+
+/*
+    the first place in order of length with a
+    length of at least that given
+*/
+static int find_length(const t_fp_index *index, const long long length)
+{
+    int lo = 0, hi = index->count, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+
+        if (index->length[mid] < length) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/*
+    is the average fit and dominant line of the
+    fingerprint at place i in order of length
+    within tolerance of those given
+*/
+static int within(const t_fp_index *index, const int i, const int fit, const int avgdom)
+{
+    return (index->fit_tolerance < 0 || abs(index->fit[i] - fit) <= index->fit_tolerance)
+        && (index->avgdom_tolerance < 0 || abs(index->avgdom[i] - avgdom) <= index->avgdom_tolerance);
+}
+
+FOOIDAPI int fp_index_query(const t_fp_index *index, const unsigned char *query,
+                            int k, int *ids, float *distances)
+{
+    unsigned int keys[INDEX_TABLES][MAX_PROBES];
+    int probes[INDEX_TABLES];
+    unsigned int *cands;
+    int *best;
+    size_t total = 0, n, unique;
+    int level, found = 0;
+    int filter, lo, hi, fit, avgdom;
+    int key;
+    int i, j;
+
+    if (index == NULL || query == NULL || k < 0
+        || (k > 0 && (ids == NULL || distances == NULL))) {
+        return -1;
+    }
+
+    if (k == 0 || index->count == 0) {
+        return 0;
+    }
+
+    /*
+        the places in order of length with the
+        length in tolerance, from lo to hi - 1
+    */
+    filter = index->length_tolerance >= 0 || index->fit_tolerance >= 0
+          || index->avgdom_tolerance >= 0;
+    fit = get_short(query, FP_FIT_OFFSET);
+    avgdom = get_short(query, FP_AVGDOM_OFFSET);
+    lo = 0;
+    hi = index->count;
+
+    if (index->length_tolerance >= 0) {
+        long long length = get_int(query, FP_LENGTH_OFFSET);
+
+        lo = find_length(index, length - index->length_tolerance);
+        hi = find_length(index, length + index->length_tolerance + 1);
+    }
+
+    for (i = 0; i < INDEX_TABLES; i++) {
+        probes[i] = get_probes(index, i, query + FP_R_OFFSET, keys[i]);
+
+        for (j = 0; j < probes[i]; j++) {
+            total += index->start[i][keys[i][j] + 1] - index->start[i][keys[i][j]];
+        }
+    }
+
+    /*
+        gather the fingerprints in tolerance, from
+        the buckets probed, or all of them if there
+        are no more of those than in the buckets
+    */
+    if ((size_t)(hi - lo) <= total) {
+        cands = (unsigned int *)mem_alloc(NULL, sizeof(unsigned int) * (hi > lo ? hi - lo : 1));
+
+        if (cands == NULL) {
+            return -1;
+        }
+
+        for (i = lo, n = 0; i < hi; i++) {
+            if (within(index, i, fit, avgdom)) {
+                cands[n++] = (unsigned int)index->position[i];
+            }
+        }
+    } else {
+        cands = (unsigned int *)mem_alloc(NULL, sizeof(unsigned int) * total);
+
+        if (cands == NULL) {
+            return -1;
+        }
+
+        for (i = 0, n = 0; i < INDEX_TABLES; i++) {
+            for (j = 0; j < probes[i]; j++) {
+                unsigned int from = index->start[i][keys[i][j]];
+                unsigned int to = index->start[i][keys[i][j] + 1];
+
+                if (!filter) {
+                    memcpy(cands + n, index->entries[i] + from, sizeof(unsigned int) * (to - from));
+                    n += to - from;
+                    continue;
+                }
+
+                for (; from < to; from++) {
+                    int rank = index->rank[index->entries[i][from]];
+
+                    if (rank >= lo && rank < hi && within(index, rank, fit, avgdom)) {
+                        cands[n++] = index->entries[i][from];
+                    }
+                }
+            }
+        }
+    }
+
+    if (n == 0) {
+        mem_free(NULL, cands);
+        return 0;
+    }
+
+    /*
+        in the order of the array and each only once
+    */
+    total = n;
+    qsort(cands, total, sizeof(unsigned int), compare_positions);
+
+    for (n = 1, unique = 1; n < total; n++) {
+        if (cands[n] != cands[unique - 1]) {
+            cands[unique++] = cands[n];
+        }
+    }
+
+    /*
+        score them, keeping the k best in a max-heap
+        of positions, with the worst at the top
+    */
+    best = (int *)mem_alloc(NULL, sizeof(int) * ((size_t)k < unique ? (size_t)k : unique));
+
+    if (best == NULL) {
+        mem_free(NULL, cands);
+        return -1;
+    }
+
+    level = compare_simd_level();
+
+    for (n = 0; n < unique && n < AHEAD; n++) {
+        prefetch_fp(index->base + (size_t)cands[n] * index->stride);
+    }
+
+    for (n = 0; n < unique; n++) {
+        const unsigned char *fp = index->base + (size_t)cands[n] * index->stride;
+
+        if (n + AHEAD < unique) {
+            prefetch_fp(index->base + (size_t)cands[n + AHEAD] * index->stride);
+        }
+
+        if (found < k) {
+            best[found] = distance_key(compare_bound(query, fp, level, 2.0f));
+            ids[found] = (int)cands[n];
+            sift_up(ids, best, found);
+            found++;
+        } else {
+            key = distance_key(compare_bound(query, fp, level, key_distance(best[0])));
+
+            if (key < best[0]) {
+                best[0] = key;
+                ids[0] = (int)cands[n];
+                sift_down(ids, best, found, 0);
+            }
+        }
+    }
+
+    mem_free(NULL, cands);
+
+    /*
+        sort, best first, and go from positions
+        in the array to the ids given
+    */
+    heap_sort(ids, best, found);
+
+    for (i = 0; i < found; i++) {
+        distances[i] = key_distance(best[i]);
+    }
+
+    mem_free(NULL, best);
+
+    for (i = 0; i < found; i++) {
+        ids[i] = index->ids[ids[i]];
+    }
+
+    return found;
+}
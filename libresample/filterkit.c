@@ -25,6 +25,10 @@
 #include <stdio.h>
 #include <math.h>
 
+#ifdef FILTERKIT_SSE2
+#include <emmintrin.h>
+#endif
+
 /* LpFilter()
  *
  * reference: "Digital Filters, 2nd edition"
@@ -209,3 +213,101 @@ float FilterUD(float Imp[],  /* impulse response */
 
    return v;
 }
+
+#ifdef FILTERKIT_SSE2
+
+/* FilterUD4() - FilterUD() at four points at once, without coefficient
+ * interpolation, one point per vector lane.
+ *
+ * Every lane sums its taps in the same order as FilterUD(), so the
+ * results are identical to four separate calls. Up to Nsafe taps, where
+ * no lane can have reached the end of the wing yet, the lanes run
+ * unmasked; after that, lanes that run out of taps keep their value.
+ *
+ * The input samples of each lane are contiguous, so they are loaded
+ * four taps at a time and transposed into one vector per tap. This may
+ * read up to three samples past the last tap, which stays within the
+ * Xoff guard band around the converter's input.
+ */
+void FilterUD4(float Imp[], UWORD Nwing, float X[], int Xi[4],
+               float Ph[4], int Inc, float dhb, float v[4])
+{
+   __m128 Ho, dh, x0, x1, x2, x3, c, vv;
+   __m128i h, act, end;
+   float Ht[4];
+   int hi[4];
+   int End = Nwing;
+   int Nsafe, m, j, k;
+
+   dh = _mm_set1_ps(dhb);
+   Ho = _mm_mul_ps(_mm_loadu_ps(Ph), dh);
+
+   if (Inc == 1) {
+      End--;
+      Ho = _mm_add_ps(Ho, _mm_and_ps(dh,
+              _mm_cmpeq_ps(_mm_loadu_ps(Ph), _mm_setzero_ps())));
+   }
+
+   /* Rounding in the Ho steps is far below dhb, two taps of
+      margin are plenty */
+   _mm_storeu_ps(Ht, Ho);
+   Nsafe = End;
+   for (k = 0; k < 4; k++)
+      Nsafe = MIN(Nsafe, (int)((End - Ht[k]) / dhb) - 2);
+
+   end = _mm_set1_epi32(End);
+   vv = _mm_setzero_ps();
+
+   for (m = 0; ; m += 4) {
+      if (Inc == 1) {
+         x0 = _mm_loadu_ps(&X[Xi[0] + m]);
+         x1 = _mm_loadu_ps(&X[Xi[1] + m]);
+         x2 = _mm_loadu_ps(&X[Xi[2] + m]);
+         x3 = _mm_loadu_ps(&X[Xi[3] + m]);
+      }
+      else {
+         x0 = _mm_loadu_ps(&X[Xi[0] - m - 3]);
+         x1 = _mm_loadu_ps(&X[Xi[1] - m - 3]);
+         x2 = _mm_loadu_ps(&X[Xi[2] - m - 3]);
+         x3 = _mm_loadu_ps(&X[Xi[3] - m - 3]);
+         x0 = _mm_shuffle_ps(x0, x0, _MM_SHUFFLE(0, 1, 2, 3));
+         x1 = _mm_shuffle_ps(x1, x1, _MM_SHUFFLE(0, 1, 2, 3));
+         x2 = _mm_shuffle_ps(x2, x2, _MM_SHUFFLE(0, 1, 2, 3));
+         x3 = _mm_shuffle_ps(x3, x3, _MM_SHUFFLE(0, 1, 2, 3));
+      }
+      _MM_TRANSPOSE4_PS(x0, x1, x2, x3);
+
+      for (j = 0; j < 4; j++) {
+         h = _mm_cvttps_epi32(Ho);
+
+         if (m + j < Nsafe) {
+            _mm_storeu_si128((__m128i *)hi, h);
+            c = _mm_setr_ps(Imp[hi[0]], Imp[hi[1]], Imp[hi[2]], Imp[hi[3]]);
+            c = _mm_mul_ps(c, x0);
+            vv = _mm_add_ps(vv, c);
+         }
+         else {
+            act = _mm_cmplt_epi32(h, end);
+            if (_mm_movemask_ps(_mm_castsi128_ps(act)) == 0) {
+               _mm_storeu_ps(v, vv);
+               return;
+            }
+
+            _mm_storeu_si128((__m128i *)hi, _mm_and_si128(h, act));
+            c = _mm_setr_ps(Imp[hi[0]], Imp[hi[1]], Imp[hi[2]], Imp[hi[3]]);
+            c = _mm_mul_ps(c, x0);
+            c = _mm_add_ps(vv, c);
+            vv = _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(act), c),
+                           _mm_andnot_ps(_mm_castsi128_ps(act), vv));
+         }
+
+         Ho = _mm_add_ps(Ho, dh);
+
+         x0 = x1;
+         x1 = x2;
+         x2 = x3;
+      }
+   }
+}
+
+#endif
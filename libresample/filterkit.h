@@ -26,3 +26,16 @@ float FilterUD(float Imp[], float ImpD[], UWORD Nwing, BOOL Interp,
                float *Xp, float Ph, int Inc, float dhb);
 
 void LpFilter(float c[], int N, float frq, float Beta, int Num);
+
+/*
+ * FilterUD4() applies the down-conversion filter at four points at once,
+ * without coefficient interpolation. Xi[] are the indices of the current
+ * samples in X[], Ph[] their phases, v[] receives the four results.
+ */
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+                          || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FILTERKIT_SSE2
+
+void FilterUD4(float Imp[], UWORD Nwing, float X[], int Xi[4],
+               float Ph[4], int Inc, float dhb, float v[4]);
+#endif
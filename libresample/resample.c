@@ -27,9 +27,18 @@
 #include <math.h>
 #include <string.h>
 
+/* Allocator for handle memory, NULL means malloc and free */
 typedef struct {
+   void *(*alloc)(void *ctx, size_t size);
+   void (*release)(void *ctx, void *ptr);
+   void *ctx;
+} rsalloc;
+
+typedef struct {
+   rsalloc mem;
    float  *Imp;
    float  *ImpD;
+   BOOL    ownFilter; /* Imp and ImpD are ours to free */
    float   LpScl;
    UWORD   Nmult;
    UWORD   Nwing;
@@ -42,14 +51,97 @@ typedef struct {
    UWORD   Xoff;
    UWORD   YSize;
    float  *Y;
-   UWORD   Yp;
+   UWORD   Yp; /* Number of samples left in Y */
+   UWORD   Yr; /* Position of the first of them */
    float  Time;
 } rsdata;
 
-void *resample_open(int highQuality, float minFactor, float maxFactor)
+static void *rs_malloc(const rsalloc *mem, size_t size)
+{
+   if (mem->alloc)
+      return mem->alloc(mem->ctx, size);
+   return malloc(size);
+}
+
+static void rs_free(const rsalloc *mem, void *ptr)
+{
+   if (!ptr)
+      return;
+   if (mem->release)
+      mem->release(mem->ctx, ptr);
+   else
+      free(ptr);
+}
+
+static int make_filter(const rsalloc *mem, int highQuality,
+                       float **Imp, float **ImpD)
 {
    float *Imp64;
    float Rolloff, Beta;
+   UWORD Nmult, Nwing;
+   int i;
+
+   if (highQuality)
+      Nmult = 35;
+   else
+      Nmult = 11;
+
+   Nwing = Npc*(Nmult-1)/2; /* # of filter coeffs in right wing */
+
+   Rolloff = 0.90f;
+   Beta = 6;
+
+   Imp64 = (float *)rs_malloc(mem, Nwing * sizeof(float));
+   *Imp = (float *)rs_malloc(mem, Nwing * sizeof(float));
+   *ImpD = (float *)rs_malloc(mem, Nwing * sizeof(float));
+
+   if (!Imp64 || !*Imp || !*ImpD) {
+      rs_free(mem, Imp64);
+      rs_free(mem, *Imp);
+      rs_free(mem, *ImpD);
+      *Imp = NULL;
+      *ImpD = NULL;
+      return 0;
+   }
+
+   LpFilter(Imp64, Nwing, 0.5f*Rolloff, Beta, Npc);
+
+   for(i=0; i<Nwing; i++)
+      (*Imp)[i] = Imp64[i];
+
+   /* Storing deltas in ImpD makes linear interpolation
+      of the filter coefficients faster */
+   for (i=0; i<Nwing-1; i++)
+      (*ImpD)[i] = (*Imp)[i+1] - (*Imp)[i];
+
+   /* Last coeff. not interpolated */
+   (*ImpD)[Nwing-1] = - (*Imp)[Nwing-1];
+
+   rs_free(mem, Imp64);
+
+   return Nwing;
+}
+
+int resample_make_filter(int highQuality, float **Imp, float **ImpD)
+{
+   rsalloc mem = { NULL, NULL, NULL };
+
+   return make_filter(&mem, highQuality, Imp, ImpD);
+}
+
+void *resample_open(int highQuality, float minFactor, float maxFactor)
+{
+   return resample_open_filter(highQuality, minFactor, maxFactor,
+                               NULL, NULL, NULL, NULL, NULL);
+}
+
+void *resample_open_filter(int highQuality, float minFactor, float maxFactor,
+                           float *Imp, float *ImpD,
+                           void *(*alloc)(void *ctx, size_t size),
+                           void (*release)(void *ctx, void *ptr),
+                           void *ctx)
+{
+   rsalloc mem;
    rsdata *hp;
    UWORD   Xoff_min, Xoff_max;
    int i;
@@ -65,7 +157,22 @@ void *resample_open(int highQuality, float minFactor, float maxFactor)
       return 0;
    }
 
-   hp = (rsdata *)malloc(sizeof(rsdata));
+   if (alloc && release) {
+      mem.alloc = alloc;
+      mem.release = release;
+      mem.ctx = ctx;
+   }
+   else {
+      mem.alloc = NULL;
+      mem.release = NULL;
+      mem.ctx = NULL;
+   }
+
+   hp = (rsdata *)rs_malloc(&mem, sizeof(rsdata));
+   if (!hp)
+      return 0;
+
+   hp->mem = mem;
 
    hp->minFactor = minFactor;
    hp->maxFactor = maxFactor;
@@ -78,27 +185,22 @@ void *resample_open(int highQuality, float minFactor, float maxFactor)
    hp->LpScl = 1.0f;
    hp->Nwing = Npc*(hp->Nmult-1)/2; /* # of filter coeffs in right wing */
 
-   Rolloff = 0.90f;
-   Beta = 6;
-
-   Imp64 = (float *)malloc(hp->Nwing * sizeof(float));
-
-   LpFilter(Imp64, hp->Nwing, 0.5f*Rolloff, Beta, Npc);
-
-   hp->Imp = (float *)malloc(hp->Nwing * sizeof(float));
-   hp->ImpD = (float *)malloc(hp->Nwing * sizeof(float));
-   for(i=0; i<hp->Nwing; i++)
-      hp->Imp[i] = Imp64[i];
+   hp->X = NULL;
+   hp->Y = NULL;
 
-   /* Storing deltas in ImpD makes linear interpolation
-      of the filter coefficients faster */
-   for (i=0; i<hp->Nwing-1; i++)
-      hp->ImpD[i] = hp->Imp[i+1] - hp->Imp[i];
-
-   /* Last coeff. not interpolated */
-   hp->ImpD[hp->Nwing-1] = - hp->Imp[hp->Nwing-1];
-
-   free(Imp64);
+   /* Use the caller's filter tables if we got them */
+   if (Imp && ImpD) {
+      hp->Imp = Imp;
+      hp->ImpD = ImpD;
+      hp->ownFilter = FALSE;
+   }
+   else {
+      hp->ownFilter = TRUE;
+      if (!make_filter(&mem, highQuality, &hp->Imp, &hp->ImpD)) {
+         resample_close(hp);
+         return 0;
+      }
+   }
 
    /* Calc reach of LP filter wing (plus some creeping room) */
    Xoff_min = ((hp->Nmult+1)/2.0f) * MAX(1.0f, 1.0f/minFactor) + 10;
@@ -111,7 +213,11 @@ void *resample_open(int highQuality, float minFactor, float maxFactor)
       we can zero-pad up to Xoff zeros at the end when we reach the
       end of the input samples. */
    hp->XSize = MAX(2*hp->Xoff+10, 4096);
-   hp->X = (float *)malloc((hp->XSize + hp->Xoff) * sizeof(float));
+   hp->X = (float *)rs_malloc(&mem, (hp->XSize + hp->Xoff) * sizeof(float));
+   if (!hp->X) {
+      resample_close(hp);
+      return 0;
+   }
    hp->Xp = hp->Xoff;
    hp->Xread = hp->Xoff;
 
@@ -122,8 +228,13 @@ void *resample_open(int highQuality, float minFactor, float maxFactor)
    /* Make the outBuffer long enough to hold the entire processed
       output of one inBuffer */
    hp->YSize = (int)(((float)hp->XSize)*maxFactor+2.0);
-   hp->Y = (float *)malloc(hp->YSize * sizeof(float));
+   hp->Y = (float *)rs_malloc(&mem, hp->YSize * sizeof(float));
+   if (!hp->Y) {
+      resample_close(hp);
+      return 0;
+   }
    hp->Yp = 0;
+   hp->Yr = 0;
 
    hp->Time = (float)hp->Xoff; /* Current-time pointer for converter */
 
@@ -136,6 +247,36 @@ int resample_get_filter_width(void   *handle)
    return hp->Xoff;
 }
 
+/* Copy as many samples as fit from the Y buffer to the output buffer */
+static int drain_y(rsdata *hp, float *outBuffer, int outBufferLen)
+{
+   int len = MIN(outBufferLen, hp->Yp);
+
+   memcpy(outBuffer, &hp->Y[hp->Yr], len * sizeof(float));
+   hp->Yp -= len;
+   hp->Yr = hp->Yp ? hp->Yr + len : 0;
+
+   return len;
+}
+
+void resample_reset(void *handle)
+{
+   rsdata *hp = (rsdata *)handle;
+   int i;
+
+   hp->Xp = hp->Xoff;
+   hp->Xread = hp->Xoff;
+
+   /* Need Xoff zeros at begining of X buffer */
+   for(i=0; i<hp->Xoff; i++)
+      hp->X[i]=0;
+
+   hp->Yp = 0;
+   hp->Yr = 0;
+
+   hp->Time = (float)hp->Xoff;
+}
+
 int resample_process(void   *handle,
                      float  factor,
                      float  *inBuffer,
@@ -154,7 +295,8 @@ int resample_process(void   *handle,
    int outSampleCount;
    UWORD Nout, Ncreep, Nreuse;
    int Nx;
-   int i, len;
+   int len;
+   float *Yout;
 
    #if DEBUG
    fprintf(stderr, "resample_process: in=%d, out=%d lastFlag=%d\n",
@@ -177,15 +319,9 @@ int resample_process(void   *handle,
 
    /* Start by copying any samples still in the Y buffer to the output
       buffer */
-   if (hp->Yp && (outBufferLen-outSampleCount)>0) {
-      len = MIN(outBufferLen-outSampleCount, hp->Yp);
-      for(i=0; i<len; i++)
-         outBuffer[outSampleCount+i] = hp->Y[i];
-      outSampleCount += len;
-      for(i=0; i<hp->Yp-len; i++)
-         hp->Y[i] = hp->Y[i+len];
-      hp->Yp -= len;
-   }
+   if (hp->Yp && (outBufferLen-outSampleCount)>0)
+      outSampleCount += drain_y(hp, &outBuffer[outSampleCount],
+                                outBufferLen-outSampleCount);
 
    /* If there are still output samples left, return now - we need
       the full output buffer available to us... */
@@ -212,8 +348,7 @@ int resample_process(void   *handle,
       if (len >= (inBufferLen - (*inBufferUsed)))
          len = (inBufferLen - (*inBufferUsed));
 
-      for(i=0; i<len; i++)
-         hp->X[hp->Xread + i] = inBuffer[(*inBufferUsed) + i];
+      memcpy(&hp->X[hp->Xread], &inBuffer[*inBufferUsed], len * sizeof(float));
 
       *inBufferUsed += len;
       hp->Xread += len;
@@ -223,8 +358,7 @@ int resample_process(void   *handle,
             end of the input buffer and make sure we process
             all the way to the end */
          Nx = hp->Xread - hp->Xoff;
-         for(i=0; i<hp->Xoff; i++)
-            hp->X[hp->Xread + i] = 0;
+         memset(&hp->X[hp->Xread], 0, hp->Xoff * sizeof(float));
       }
       else
          Nx = hp->Xread - 2 * hp->Xoff;
@@ -236,13 +370,20 @@ int resample_process(void   *handle,
       if (Nx <= 0)
          break;
 
+      /* Resample straight into the output buffer if it has room
+         for a whole block, otherwise go through Y */
+      if (outBufferLen - outSampleCount >= hp->YSize)
+         Yout = &outBuffer[outSampleCount];
+      else
+         Yout = hp->Y;
+
       /* Resample stuff in input buffer */
       if (factor >= 1) {      /* SrcUp() is faster if we can use it */
-         Nout = SrcUp(hp->X, hp->Y, factor, &hp->Time, Nx,
+         Nout = SrcUp(hp->X, Yout, factor, &hp->Time, Nx,
                       Nwing, LpScl, Imp, ImpD, interpFilt);
       }
       else {
-         Nout = SrcUD(hp->X, hp->Y, factor, &hp->Time, Nx,
+         Nout = SrcUD(hp->X, Yout, factor, &hp->Time, Nx,
                       Nwing, LpScl, Imp, ImpD, interpFilt);
       }
 
@@ -263,8 +404,7 @@ int resample_process(void   *handle,
       /* Copy part of input signal that must be re-used */
       Nreuse = hp->Xread - (hp->Xp - hp->Xoff);
 
-      for (i=0; i<Nreuse; i++)
-         hp->X[i] = hp->X[i + (hp->Xp - hp->Xoff)];
+      memmove(hp->X, &hp->X[hp->Xp - hp->Xoff], Nreuse * sizeof(float));
 
       #ifdef DEBUG
       printf("New Xread=%d\n", Nreuse);
@@ -282,18 +422,18 @@ int resample_process(void   *handle,
          return -1;
       }
 
+      if (Yout != hp->Y) {
+         outSampleCount += Nout;
+         continue;
+      }
+
       hp->Yp = Nout;
+      hp->Yr = 0;
 
       /* Copy as many samples as possible to the output buffer */
-      if (hp->Yp && (outBufferLen-outSampleCount)>0) {
-         len = MIN(outBufferLen-outSampleCount, hp->Yp);
-         for(i=0; i<len; i++)
-            outBuffer[outSampleCount+i] = hp->Y[i];
-         outSampleCount += len;
-         for(i=0; i<hp->Yp-len; i++)
-            hp->Y[i] = hp->Y[i+len];
-         hp->Yp -= len;
-      }
+      if (hp->Yp && (outBufferLen-outSampleCount)>0)
+         outSampleCount += drain_y(hp, &outBuffer[outSampleCount],
+                                   outBufferLen-outSampleCount);
 
       /* If there are still output samples left, return now,
          since we need the full output buffer available */
@@ -307,10 +447,13 @@ int resample_process(void   *handle,
 void resample_close(void *handle)
 {
    rsdata *hp = (rsdata *)handle;
-   free(hp->X);
-   free(hp->Y);
-   free(hp->Imp);
-   free(hp->ImpD);
-   free(hp);
+   rsalloc mem = hp->mem;
+   rs_free(&mem, hp->X);
+   rs_free(&mem, hp->Y);
+   if (hp->ownFilter) {
+      rs_free(&mem, hp->Imp);
+      rs_free(&mem, hp->ImpD);
+   }
+   rs_free(&mem, hp);
 }
 
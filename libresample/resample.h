@@ -14,6 +14,10 @@
 #ifndef LIBRESAMPLE_INCLUDED
 #define LIBRESAMPLE_INCLUDED
 
+#include "resample_prefix.h"
+
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif	/* __cplusplus */
@@ -22,8 +26,34 @@ void *resample_open(int      highQuality,
                     float   minFactor,
                     float   maxFactor);
 
+/* Build the lowpass filter tables resample_open() would use, so that
+   they can be shared between handles through resample_open_filter().
+   The tables come from malloc. Returns the number of coefficients
+   per table, 0 on failure. */
+int resample_make_filter(int      highQuality,
+                         float  **Imp,
+                         float  **ImpD);
+
+/* Same as resample_open(), using tables from resample_make_filter()
+   with the same highQuality setting, or tables of its own if Imp or
+   ImpD is NULL. The tables are not copied and must outlive the handle.
+   The handle, its buffers and its own tables are allocated through
+   alloc and release, which both get ctx; NULL means malloc and free. */
+void *resample_open_filter(int      highQuality,
+                           float   minFactor,
+                           float   maxFactor,
+                           float   *Imp,
+                           float   *ImpD,
+                           void   *(*alloc)(void *ctx, size_t size),
+                           void    (*release)(void *ctx, void *ptr),
+                           void   *ctx);
+
 int resample_get_filter_width(void *handle);
 
+/* Drop all buffered input and output, as if the handle was
+   just opened. */
+void resample_reset(void *handle);
+
 int resample_process(void   *handle,
                      float  factor,
                      float  *inBuffer,
@@ -14,6 +14,8 @@
 #ifndef __RESAMPLE_DEFS__
 #define __RESAMPLE_DEFS__
 
+#include "resample_prefix.h"
+
 #ifdef WIN32
 #include "configwin.h"
 #else
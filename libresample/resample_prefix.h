@@ -0,0 +1,30 @@
+/**********************************************************************
+
+  resample_prefix.h
+
+  Prefixed names for the copy of libresample inside libFooID, so
+  that a program can link both libFooID and its own libresample
+
+  License: LGPL - see the file LICENSE.txt for more information
+
+**********************************************************************/
+
+#ifndef __RESAMPLE_PREFIX__
+#define __RESAMPLE_PREFIX__
+
+#define resample_make_filter       fooid_resample_make_filter
+#define resample_open              fooid_resample_open
+#define resample_open_filter       fooid_resample_open_filter
+#define resample_get_filter_width  fooid_resample_get_filter_width
+#define resample_process           fooid_resample_process
+#define resample_reset             fooid_resample_reset
+#define resample_close             fooid_resample_close
+
+#define LpFilter                   fooid_LpFilter
+#define FilterUp                   fooid_FilterUp
+#define FilterUD                   fooid_FilterUD
+#define FilterUD4                  fooid_FilterUD4
+#define SrcUp                      fooid_SrcUp
+#define SrcUD                      fooid_SrcUD
+
+#endif
@@ -24,6 +24,29 @@
 #include <math.h>
 #include <string.h>
 
+#ifdef FILTERKIT_SSE2
+
+/* Advance Time by up to four output samples, filling T[] with their
+ * times. Unused entries repeat the first time so they stay in range.
+ */
+static int NextTimes4(float *Time, float dt, float endTime, float T[4])
+{
+    int n = 0;
+    int k;
+
+    do {
+        T[n++] = *Time;
+        *Time += dt;
+    } while (n < 4 && *Time < endTime);
+
+    for (k = n; k < 4; k++)
+        T[k] = T[0];
+
+    return n;
+}
+
+#endif
+
 /* Sampling rate up-conversion only subroutine;
  * Slightly faster than down-conversion;
  */
@@ -92,6 +115,37 @@ int SrcUD(float X[],
 
     Ystart = Y;
     endTime = *Time + Nx;
+
+#ifdef FILTERKIT_SSE2
+    if (!Interp) {
+        float T[4], Phl[4], Phr[4], vl[4], vr[4];
+        int Xl[4], Xr[4];
+        int n, k;
+
+        while (*Time < endTime)
+        {
+            n = NextTimes4(Time, dt, endTime, T);
+            for (k = 0; k < 4; k++) {
+                Xl[k] = (int)T[k];
+                Xr[k] = Xl[k] + 1;
+                Phl[k] = T[k] - floor(T[k]);
+                Phr[k] = (-T[k]) - floor(-T[k]);
+            }
+
+            FilterUD4(Imp, Nwing, X, Xl, Phl, -1, dh, vl);
+            FilterUD4(Imp, Nwing, X, Xr, Phr, 1, dh, vr);
+
+            for (k = 0; k < n; k++) {
+                v = vl[k];
+                v += vr[k];
+                v *= LpScl;
+                *Y++ = v;
+            }
+        }
+        return (Y - Ystart);
+    }
+#endif
+
     while (*Time < endTime)
     {
         Xp = &X[(int)(*Time)];     /* Ptr to current input sample */
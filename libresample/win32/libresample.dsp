@@ -117,6 +117,10 @@ SOURCE=..\resample_defs.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\resample_prefix.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\resource.h
 # End Source File
 # End Group
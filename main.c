@@ -1,26 +1,61 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 #include "main.h"
 
 #include "fooid.h"
 #include "sndfile.h"
+#include "thread.h"
+#include "s_fft_simd.h"
+#include "common.h"
+#include "compare.h"
 
-int main(int argc, char ** argv)
+/*
+    largest difference allowed between two FFT
+    results, relative to the largest magnitude
+    in the spectrum
+*/
+#define FFT_TOLERANCE   1e-5f
+
+/*
+    fingerprint a file, with the exact or the fast log
+
+    output *   0 on success
+             < 0 on error
+*/
+static int fingerprint_file(const char * filename, int exact, int verbose, unsigned char * buffer)
 {
-    if (argc < 2)
+    SF_INFO * sfinfo = malloc(sizeof(*sfinfo));
+    memset(sfinfo, 0, sizeof(*sfinfo));
+
+    SNDFILE * file = sf_open(filename, SFM_READ, sfinfo);
+
+    if (file == NULL)
     {
-        printf("Usage: ./test filename.wav\n");
-        return 0;
+        printf("Could not open %s\n", filename);
+        free(sfinfo);
+        return -1;
     }
 
-    SF_INFO * sfinfo = malloc(sizeof(*sfinfo));
-    SNDFILE * file = sf_open(argv[1], SFM_READ, sfinfo);
-
-    print_file_info(sfinfo);
+    if (verbose)
+    {
+        print_file_info(sfinfo);
+    }
 
     t_fooid * fooid = fp_init(sfinfo->samplerate, sfinfo->channels);
 
+    if (fooid == NULL)
+    {
+        printf("Could not set up fingerprinting for %s\n", filename);
+        sf_close(file);
+        free(sfinfo);
+        return -1;
+    }
+
+    fp_set_exact_log(fooid, exact);
+
     short * data = malloc(sizeof(short) * sfinfo->channels * sfinfo->samplerate);
 
     int centiseconds = 0;
@@ -45,34 +80,1322 @@ int main(int argc, char ** argv)
         }
     }
 
-    unsigned char * buffer =  malloc(fp_getsize(fooid));
-
     int result = fp_calculate(fooid, centiseconds, buffer);
 
-    if (result < 0)
+    sf_close(file);
+    fp_free(fooid);
+    free(data);
+    free(sfinfo);
+
+    return result;
+}
+
+/*
+    get the 6-bit dominant line of a frame
+*/
+static int get_dom(const unsigned char * buffer, int frame)
+{
+    const unsigned char * dom = buffer + FP_DOM_OFFSET + (frame / 4) * 3;
+
+    switch (frame % 4)
     {
-        printf("Failed to calculate fingerprint\n");
+    case 0:
+        return dom[0] >> 2;
+    case 1:
+        return ((dom[0] & 0x3) << 4) | (dom[1] >> 4);
+    case 2:
+        return ((dom[1] & 0xF) << 2) | (dom[2] >> 6);
+    default:
+        return dom[2] & 0x3F;
     }
-    else
+}
+
+/*
+    report how many quantized spectral fits and
+    dominant lines change between the exact and
+    the fast log, for each file and in total
+*/
+static int compare_logs(int count, char ** filenames)
+{
+    unsigned char * exact = malloc(fp_getsize(NULL));
+    unsigned char * fast = malloc(fp_getsize(NULL));
+    long total_r = 0, total_dom = 0;
+    long changed_r = 0, changed_dom = 0;
+    int i, j;
+
+    printf("%-40s %12s %12s\n", "file", "fits", "doms");
+
+    for (i = 0; i < count; i++)
     {
-        int i;
-        for (i = 0; i < fp_getsize(fooid); i++)
+        if (fingerprint_file(filenames[i], 1, 0, exact) < 0
+            || fingerprint_file(filenames[i], 0, 0, fast) < 0)
         {
-            if (!(i % 32))
+            printf("%-40s failed\n", filenames[i]);
+            continue;
+        }
+
+        int r = 0, dom = 0;
+
+        for (j = 0; j < FP_R_BYTES * 4; j++)
+        {
+            int shift = 6 - 2 * (j % 4);
+
+            if (((exact[FP_R_OFFSET + j / 4] >> shift) & 3) != ((fast[FP_R_OFFSET + j / 4] >> shift) & 3))
             {
-                printf("\n");
+                r++;
             }
+        }
 
-            printf("%02x ", (int) buffer[i]);
+        for (j = 0; j < FP_FRAMES; j++)
+        {
+            if (get_dom(exact, j) != get_dom(fast, j))
+            {
+                dom++;
+            }
         }
 
-        printf("\n");
+        printf("%-40s %5d / %4d %5d / %4d\n", filenames[i], r, FP_R_BYTES * 4, dom, FP_FRAMES);
+
+        changed_r += r;
+        changed_dom += dom;
+        total_r += FP_R_BYTES * 4;
+        total_dom += FP_FRAMES;
+    }
+
+    if (total_r > 0)
+    {
+        printf("\nchanged fits %ld of %ld (%.4f%%), doms %ld of %ld (%.4f%%)\n",
+               changed_r, total_r, 100.0 * changed_r / total_r,
+               changed_dom, total_dom, 100.0 * changed_dom / total_dom);
+    }
+
+    free(exact);
+    free(fast);
+
+    return 0;
+}
+
+/*
+    a whole file in memory, for the stress test
+*/
+typedef struct
+{
+    short * data;
+    int size;
+    int samplerate;
+    int channels;
+    int centiseconds;
+    unsigned char * fingerprint;
+} t_song;
+
+typedef struct
+{
+    t_song * songs;
+    int count;
+    int first;
+    int mismatches;
+    int failures;
+    t_thread thread;
+} t_stress;
+
+static int load_song(const char * filename, t_song * song)
+{
+    SF_INFO sfinfo;
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    memset(song, 0, sizeof(*song));
+
+    SNDFILE * file = sf_open(filename, SFM_READ, &sfinfo);
+
+    if (file == NULL)
+    {
+        printf("Could not open %s\n", filename);
+        return -1;
+    }
+
+    song->size = (int) sfinfo.frames * sfinfo.channels;
+    song->samplerate = sfinfo.samplerate;
+    song->channels = sfinfo.channels;
+    song->centiseconds = (int) (100 * sfinfo.frames / sfinfo.samplerate);
+    song->data = malloc(sizeof(short) * song->size);
+    song->fingerprint = malloc(fp_getsize(NULL));
+
+    song->size = (int) sf_read_short(file, song->data, song->size);
+    sf_close(file);
+
+    return 0;
+}
+
+/*
+    fingerprint a song from memory, one second
+    at a time, on a new handle or by resetting
+    the one passed in
+*/
+static int fingerprint_song(t_fooid ** fooid, const t_song * song, unsigned char * buffer)
+{
+    int chunk = song->samplerate * song->channels;
+    int pos;
+
+    if (*fooid == NULL)
+    {
+        *fooid = fp_init(song->samplerate, song->channels);
+    }
+    else if (fp_reset(*fooid, song->samplerate, song->channels) < 0)
+    {
+        fp_free(*fooid);
+        *fooid = NULL;
+    }
+
+    if (*fooid == NULL)
+    {
+        return -1;
+    }
+
+    for (pos = 0; pos < song->size; pos += chunk)
+    {
+        int len = song->size - pos < chunk ? song->size - pos : chunk;
+
+        if (fp_feed_short(*fooid, song->data + pos, len) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return fp_calculate(*fooid, song->centiseconds, buffer);
+}
+
+/*
+    one stress thread, going through all the songs
+    on one handle, starting from its own song
+*/
+static THREAD_PROC(stress_thread, arg)
+{
+    t_stress * st = arg;
+    t_fooid * fooid = NULL;
+    unsigned char * buffer = malloc(fp_getsize(NULL));
+    int i;
+
+    for (i = 0; i < st->count; i++)
+    {
+        const t_song * song = &st->songs[(st->first + i) % st->count];
+
+        if (fingerprint_song(&fooid, song, buffer) < 0)
+        {
+            st->failures++;
+        }
+        else if (memcmp(buffer, song->fingerprint, fp_getsize(NULL)) != 0)
+        {
+            st->mismatches++;
+        }
+    }
+
+    if (fooid != NULL)
+    {
+        fp_free(fooid);
+    }
+    free(buffer);
+
+    THREAD_RETURN;
+}
+
+/*
+    fingerprint the files on many threads at once,
+    each with its own handle, and check that every
+    fingerprint matches the one made serially
+*/
+static int stress(int threads, int count, char ** filenames)
+{
+    t_song * songs = malloc(sizeof(t_song) * count);
+    t_stress * st = malloc(sizeof(t_stress) * threads);
+    int mismatches = 0, failures = 0, started = 0;
+    int i, loaded = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        t_fooid * fooid = NULL;
+
+        if (load_song(filenames[i], &songs[loaded]) < 0)
+        {
+            continue;
+        }
+
+        if (fingerprint_song(&fooid, &songs[loaded], songs[loaded].fingerprint) < 0)
+        {
+            printf("%s cannot be fingerprinted, skipped\n", filenames[i]);
+            free(songs[loaded].data);
+            free(songs[loaded].fingerprint);
+        }
+        else
+        {
+            loaded++;
+        }
+
+        if (fooid != NULL)
+        {
+            fp_free(fooid);
+        }
+    }
+
+    if (loaded > 0)
+    {
+        for (i = 0; i < threads; i++)
+        {
+            st[i].songs = songs;
+            st[i].count = loaded;
+            st[i].first = i % loaded;
+            st[i].mismatches = 0;
+            st[i].failures = 0;
+
+            if (!thread_start(&st[i].thread, stress_thread, &st[i]))
+            {
+                printf("Could not start thread %d\n", i);
+                break;
+            }
+        }
+
+        started = i;
+
+        for (i = 0; i < started; i++)
+        {
+            thread_join(st[i].thread);
+            mismatches += st[i].mismatches;
+            failures += st[i].failures;
+        }
+
+        printf("%d fingerprints of %d files on %d threads: %d mismatches, %d failures\n",
+               started * loaded, loaded, started, mismatches, failures);
+    }
+
+    for (i = 0; i < loaded; i++)
+    {
+        free(songs[i].data);
+        free(songs[i].fingerprint);
+    }
+    free(songs);
+    free(st);
+
+    return (loaded > 0 && mismatches == 0 && failures == 0) ? 0 : 1;
+}
+
+/*
+    batch feeder, a song from memory one second at a time
+*/
+static int feed_song(void * user, t_fooid * fooid)
+{
+    const t_song * song = user;
+    int chunk = song->samplerate * song->channels;
+    int pos;
+
+    for (pos = 0; pos < song->size; pos += chunk)
+    {
+        int len = song->size - pos < chunk ? song->size - pos : chunk;
+
+        if (fp_feed_short(fooid, song->data + pos, len) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return song->centiseconds;
+}
+
+/*
+    fingerprint floats on a new handle
+*/
+static int fingerprint_floats(const t_song * song, float * floats, unsigned char * buffer)
+{
+    t_fooid * fooid = fp_init(song->samplerate, song->channels);
+    int result = -1;
+
+    if (fooid != NULL)
+    {
+        if (fp_feed_float(fooid, floats, song->size) >= 0)
+        {
+            result = fp_calculate(fooid, song->centiseconds, buffer);
+        }
+        fp_free(fooid);
+    }
+
+    return result;
+}
+
+/*
+    fingerprint the files in one batch, each as shorts,
+    floats and through a feeder, with a song that must
+    fail in between, on several numbers of workers, and
+    check every result against a new handle
+*/
+static int check_batch(int count, char ** filenames)
+{
+    const int workers[] = { 1, 2, 3, 8 };
+    t_song * songs = malloc(sizeof(t_song) * count);
+    float ** floats = malloc(sizeof(float *) * count);
+    unsigned char (* refs)[3][FP_SIZE] = malloc(sizeof(*refs) * count);
+    fp_batch_item * items = malloc(sizeof(fp_batch_item) * (3 * count + 1));
+    int checks = 0, failures = 0;
+    int i, j, k, w, loaded = 0, nitems;
+
+    for (i = 0; i < count; i++)
+    {
+        t_fooid * fooid = NULL;
+        t_song * song = &songs[loaded];
+
+        if (load_song(filenames[i], song) < 0)
+        {
+            continue;
+        }
+
+        floats[loaded] = malloc(sizeof(float) * (song->size > 0 ? song->size : 1));
+        for (j = 0; j < song->size; j++)
+        {
+            floats[loaded][j] = song->data[j] / 32767.0f;
+        }
+
+        if (fingerprint_song(&fooid, song, refs[loaded][0]) < 0
+            || fingerprint_floats(song, floats[loaded], refs[loaded][1]) < 0)
+        {
+            printf("%s cannot be fingerprinted, skipped\n", filenames[i]);
+            free(song->data);
+            free(song->fingerprint);
+            free(floats[loaded]);
+        }
+        else
+        {
+            memcpy(refs[loaded][2], refs[loaded][0], FP_SIZE);
+            loaded++;
+        }
+
+        if (fooid != NULL)
+        {
+            fp_free(fooid);
+        }
+    }
+
+    for (w = 0; w < (int) (sizeof(workers) / sizeof(workers[0])) && loaded > 0; w++)
+    {
+        t_fp_batch * batch = fp_batch_init(workers[w]);
+
+        if (batch == NULL)
+        {
+            printf("Could not set up a batch of %d workers\n", workers[w]);
+            failures++;
+            continue;
+        }
+
+        memset(items, 0, sizeof(fp_batch_item) * (3 * loaded + 1));
+        nitems = 0;
+
+        for (i = 0; i < loaded; i++)
+        {
+            for (k = 0; k < 3; k++)
+            {
+                fp_batch_item * item = &items[nitems++];
+
+                item->samplerate = songs[i].samplerate;
+                item->channels = songs[i].channels;
+                item->songlen = songs[i].centiseconds;
+                item->size = songs[i].size;
+
+                if (k == 0)
+                {
+                    item->shorts = songs[i].data;
+                }
+                else if (k == 1)
+                {
+                    item->floats = floats[i];
+                }
+                else
+                {
+                    item->feeder = feed_song;
+                    item->user = &songs[i];
+                }
+            }
+
+            /*
+                no samples at all, in the middle of the batch
+            */
+            if (i == loaded / 2)
+            {
+                items[nitems].samplerate = songs[i].samplerate;
+                items[nitems].channels = songs[i].channels;
+                nitems++;
+            }
+        }
+
+        int failed = fp_batch_run(batch, items, nitems);
+
+        checks++;
+        if (failed != 1)
+        {
+            printf("%d workers: %d songs failed instead of 1\n", workers[w], failed);
+            failures++;
+        }
+
+        for (i = 0, j = 0; j < nitems; j++)
+        {
+            const fp_batch_item * item = &items[j];
+
+            checks++;
+
+            if (item->shorts == NULL && item->floats == NULL && item->feeder == NULL)
+            {
+                if (item->result >= 0)
+                {
+                    printf("%d workers: song without samples did not fail\n", workers[w]);
+                    failures++;
+                }
+                continue;
+            }
+
+            k = item->shorts != NULL ? 0 : (item->floats != NULL ? 1 : 2);
+
+            if (item->result < 0
+                || memcmp(item->fingerprint, refs[i][k], FP_SIZE) != 0)
+            {
+                printf("%d workers: song %d as %s does not match\n", workers[w], i,
+                       k == 0 ? "shorts" : (k == 1 ? "floats" : "feeder"));
+                failures++;
+            }
+
+            if (k == 2)
+            {
+                i++;
+            }
+        }
+
+        fp_batch_free(batch);
+    }
+
+    if (loaded > 0)
+    {
+        printf("%d of %d checks passed\n", checks - failures, checks);
+    }
+
+    for (i = 0; i < loaded; i++)
+    {
+        free(songs[i].data);
+        free(songs[i].fingerprint);
+        free(floats[i]);
+    }
+    free(songs);
+    free(floats);
+    free(refs);
+    free(items);
+
+    return (loaded > 0 && failures == 0) ? 0 : 1;
+}
+
+/*
+    a small generator for made-up fingerprints,
+    the same on every platform
+*/
+static unsigned int next_random(unsigned int * seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+
+    return *seed >> 8;
+}
+
+/*
+    set the 2-bit spectral fit of a band in a frame
+*/
+static void set_fit(unsigned char * buffer, int frame, int band, int code)
+{
+    int j = frame * FP_R_FRAME * 4 + band;
+    int shift = 6 - 2 * (j % 4);
+    unsigned char * r = buffer + FP_R_OFFSET + j / 4;
+
+    *r = (unsigned char) ((*r & ~(3 << shift)) | (code << shift));
+}
+
+/*
+    set the 6-bit dominant line of a frame
+*/
+static void set_dom(unsigned char * buffer, int frame, int dom)
+{
+    unsigned char * d = buffer + FP_DOM_OFFSET + (frame / 4) * 3;
+    int shift = 18 - 6 * (frame % 4);
+    long v = ((long) d[0] << 16) | (d[1] << 8) | d[2];
+
+    v = (v & ~(0x3FL << shift)) | ((long) dom << shift);
+
+    d[0] = (unsigned char) (v >> 16);
+    d[1] = (unsigned char) (v >> 8);
+    d[2] = (unsigned char) v;
+}
+
+/*
+    make a pair of fingerprints where frame f of a
+    is frame f + shift of b, with a few dominant
+    lines changed, and random frames where b has
+    no frame of a; the fits are random, or if not,
+    the same in every frame so that only the
+    dominant lines tell the shifts apart
+*/
+static void make_shifted(unsigned char * a, unsigned char * b, int shift,
+                         int random_fits, unsigned int * seed)
+{
+    int length = 20000;
+    short fit = 1500, dom = 3000;
+    int frame, band, changed = 0;
+
+    memset(a, 0, fp_getsize(NULL));
+    memcpy(a + FP_LENGTH_OFFSET, &length, sizeof(length));
+    memcpy(a + FP_FIT_OFFSET, &fit, sizeof(fit));
+    memcpy(a + FP_AVGDOM_OFFSET, &dom, sizeof(dom));
+    memcpy(b, a, fp_getsize(NULL));
+
+    for (frame = 0; frame < FP_FRAMES; frame++)
+    {
+        for (band = 0; band < FP_R_FRAME * 4; band++)
+        {
+            set_fit(a, frame, band, random_fits ? (int) (next_random(seed) & 3) : band & 3);
+        }
+        set_dom(a, frame, (int) (next_random(seed) & 0x3F));
+    }
+
+    for (frame = 0; frame < FP_FRAMES; frame++)
+    {
+        int from = frame - shift;
+
+        for (band = 0; band < FP_R_FRAME * 4; band++)
+        {
+            int code = random_fits ? (int) (next_random(seed) & 3) : band & 3;
+
+            if (from >= 0 && from < FP_FRAMES)
+            {
+                code = (a[FP_R_OFFSET + from * FP_R_FRAME + band / 4] >> (6 - 2 * (band % 4))) & 3;
+            }
+            set_fit(b, frame, band, code);
+        }
+
+        if (from >= 0 && from < FP_FRAMES && changed++ % 16 != 5)
+        {
+            set_dom(b, frame, get_dom(a, from));
+        }
+        else
+        {
+            set_dom(b, frame, (int) (next_random(seed) & 0x3F));
+        }
+    }
+}
+
+static int get_fit(const unsigned char * buffer, int frame, int band)
+{
+    int j = frame * FP_R_FRAME * 4 + band;
+
+    return (buffer[FP_R_OFFSET + j / 4] >> (6 - 2 * (j % 4))) & 3;
+}
+
+/*
+    the distance at one shift, worked out frame by
+    frame, with header the part that does not
+    depend on the shift
+*/
+static float shifted_distance(const unsigned char * a, const unsigned char * b,
+                              int shift, float header)
+{
+    int first = shift < 0 ? -shift : 0;
+    int frames = FP_FRAMES - abs(shift);
+    int r = 0, dom = 0;
+    int frame, band;
+
+    for (frame = first; frame < first + frames; frame++)
+    {
+        for (band = 0; band < FP_R_FRAME * 4; band++)
+        {
+            r += abs(get_fit(a, frame, band) - get_fit(b, frame + shift, band));
+        }
+        dom += get_dom(a, frame) != get_dom(b, frame + shift);
+    }
+
+    return W_R * (float) r / (float) (3 * FP_R_FRAME * 4 * frames)
+         + W_DOM * (float) dom / (float) frames
+         + header;
+}
+
+/*
+    check fp_compare_shifted against the distance
+    at every shift up to max_shift, the nearest
+    shift winning a tie, positive before negative
+
+    output * number of failed checks
+*/
+static int check_shifted(const unsigned char * a, const unsigned char * b,
+                         int max_shift, const char * what)
+{
+    float header = fp_compare(a, b) - shifted_distance(a, b, 0, 0.0f);
+    float best = 2.0f, distance;
+    int best_shift = 0, found, i;
+
+    for (i = 0; i <= 2 * max_shift; i++)
+    {
+        int shift = (i & 1) ? (i + 1) / 2 : -(i / 2);
+        float d = shifted_distance(a, b, shift, header);
+
+        if (d < best)
+        {
+            best = d;
+            best_shift = shift;
+        }
+    }
+
+    distance = fp_compare_shifted(a, b, max_shift, &found);
+
+    if (found < -max_shift || found > max_shift
+        || fabsf(distance - best) > 1e-5f
+        || shifted_distance(a, b, found, header) - best > 1e-5f)
+    {
+        printf("%s, max shift %d: %.5f at shift %d, best is %.5f at shift %d\n",
+               what, max_shift, distance, found, best, best_shift);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+    check fp_compare_shifted on made-up pairs: that it
+    finds the shift between copies, and that it gives
+    the best distance over all shifts on pairs whose
+    dominant lines and fits line up at different shifts,
+    or not at all
+
+    output * 0 if all checks pass
+*/
+static int check_shifts(void)
+{
+    static const int shifts[] = { 0, 1, -1, 10, -10, 22, -22, 23, -23, 24, -24, 43, -43 };
+    static const int max_shifts[] = { 0, 1, 5, 20, 43 };
+    unsigned char * a = malloc(fp_getsize(NULL));
+    unsigned char * b = malloc(fp_getsize(NULL));
+    unsigned int seed = 1;
+    int failures = 0, checks = 0;
+    int i, j, m, random_fits, found;
+    char what[64];
+
+    for (i = 0; i < (int) (sizeof(shifts) / sizeof(shifts[0])); i++)
+    {
+        for (random_fits = 0; random_fits < 2; random_fits++)
+        {
+            make_shifted(a, b, shifts[i], random_fits, &seed);
+
+            float distance = fp_compare_shifted(a, b, 43, &found);
+
+            if (found != shifts[i])
+            {
+                printf("shift %d, %s fits: found shift %d at distance %.4f\n",
+                       shifts[i], random_fits ? "random" : "constant", found, distance);
+                failures++;
+            }
+            checks++;
+
+            sprintf(what, "shift %d, %s fits", shifts[i], random_fits ? "random" : "constant");
+            for (m = 0; m < (int) (sizeof(max_shifts) / sizeof(max_shifts[0])); m++)
+            {
+                failures += check_shifted(a, b, max_shifts[m], what);
+                checks++;
+            }
+        }
+    }
+
+    for (i = 0; i < 300; i++)
+    {
+        int fit_shift = (int) (next_random(&seed) % 61) - 30;
+        int dom_shift = (int) (next_random(&seed) % 61) - 30;
+
+        /*
+            fits lined up at one shift and dominant lines
+            at another, or random dominant lines
+        */
+        make_shifted(a, b, fit_shift, 1, &seed);
+
+        for (j = 0; j < FP_FRAMES; j++)
+        {
+            int from = j - dom_shift;
+
+            if (i % 3 != 2 && from >= 0 && from < FP_FRAMES && next_random(&seed) % 8 != 0)
+            {
+                set_dom(b, j, get_dom(a, from));
+            }
+            else
+            {
+                set_dom(b, j, (int) (next_random(&seed) & 0x3F));
+            }
+        }
+
+        sprintf(what, "pair %d, fits at %d, lines at %d", i, fit_shift, dom_shift);
+        for (m = 0; m < (int) (sizeof(max_shifts) / sizeof(max_shifts[0])); m++)
+        {
+            failures += check_shifted(a, b, max_shifts[m], what);
+            checks++;
+        }
+    }
+
+    printf("%d of %d checks passed\n", checks - failures, checks);
+
+    free(a);
+    free(b);
+
+    return failures == 0 ? 0 : 1;
+}
+
+typedef struct
+{
+    int score;
+    int id;
+} t_scored;
+
+static int by_score(const void * a, const void * b)
+{
+    const t_scored * x = a;
+    const t_scored * y = b;
+
+    if (x->score != y->score)
+    {
+        return x->score < y->score ? -1 : 1;
+    }
+
+    return x->id < y->id ? -1 : (x->id > y->id);
+}
+
+/*
+    check that fp_scan_topk gives the first k of all
+    the fp_scan scores sorted, the earlier fingerprint
+    first on a tie, for fingerprints with and without
+    room around them
+*/
+static int check_scan(void)
+{
+    static const int strides[] = { FP_R_OFFSET + FP_R_BYTES, FP_SIZE, 512 };
+    static const int counts[] = { 1, 7, 64, 1000 };
+    static const int ks[] = { 1, 5, 64, 1000, 1010 };
+    unsigned char * query = malloc(FP_SIZE);
+    int * scores = malloc(sizeof(int) * 1000);
+    int * ids = malloc(sizeof(int) * 1010);
+    int * top = malloc(sizeof(int) * 1010);
+    t_scored * sorted = malloc(sizeof(t_scored) * 1000);
+    unsigned int seed = 7;
+    int failures = 0, checks = 0;
+    int s, c, k, i, n;
+
+    for (s = 0; s < (int) (sizeof(strides) / sizeof(strides[0])); s++)
+    {
+        int stride = strides[s];
+        unsigned char * base = malloc(stride * 1000);
+
+        for (c = 0; c < (int) (sizeof(counts) / sizeof(counts[0])); c++)
+        {
+            int count = counts[c];
+
+            for (i = 0; i < FP_SIZE; i++)
+            {
+                query[i] = (unsigned char) next_random(&seed);
+            }
+
+            /*
+                random fingerprints, some of them copies
+                of earlier ones or close to the query,
+                so that there are ties to sort out
+            */
+            for (i = 0; i < stride * count; i++)
+            {
+                base[i] = (unsigned char) next_random(&seed);
+            }
+
+            for (i = 1; i < count; i++)
+            {
+                unsigned char * fp = base + i * stride;
+
+                if (next_random(&seed) % 4 == 0)
+                {
+                    memcpy(fp, base + (next_random(&seed) % i) * stride, stride);
+                }
+                else if (next_random(&seed) % 4 == 0)
+                {
+                    memcpy(fp + FP_R_OFFSET, query + FP_R_OFFSET, FP_R_BYTES);
+                    fp[FP_R_OFFSET + next_random(&seed) % FP_R_BYTES] ^= 1 << (next_random(&seed) % 8);
+                }
+            }
+
+            if (fp_scan(query, base, count, stride, scores) < 0)
+            {
+                printf("stride %d, %d fingerprints: fp_scan failed\n", stride, count);
+                failures++;
+                continue;
+            }
+
+            for (i = 0; i < count; i++)
+            {
+                sorted[i].score = scores[i];
+                sorted[i].id = i;
+            }
+            qsort(sorted, count, sizeof(t_scored), by_score);
+
+            for (k = 0; k < (int) (sizeof(ks) / sizeof(ks[0])); k++)
+            {
+                int wanted = ks[k] < count ? ks[k] : count;
+
+                n = fp_scan_topk(query, base, count, stride, ks[k], ids, top);
+
+                checks++;
+
+                if (n != wanted)
+                {
+                    printf("stride %d, %d fingerprints, k %d: gave %d\n", stride, count, ks[k], n);
+                    failures++;
+                    continue;
+                }
+
+                for (i = 0; i < n; i++)
+                {
+                    if (ids[i] != sorted[i].id || top[i] != sorted[i].score)
+                    {
+                        printf("stride %d, %d fingerprints, k %d: %d is %d at %d, not %d at %d\n",
+                               stride, count, ks[k], i, ids[i], top[i], sorted[i].id, sorted[i].score);
+                        failures++;
+                        break;
+                    }
+                }
+            }
+        }
+
+        free(base);
+    }
+
+    printf("%d of %d checks passed\n", checks - failures, checks);
+
+    free(query);
+    free(scores);
+    free(ids);
+    free(top);
+    free(sorted);
+
+    return failures == 0 ? 0 : 1;
+}
+
+typedef struct
+{
+    float distance;
+    int index;
+} t_ranked;
+
+static int by_distance(const void * a, const void * b)
+{
+    const t_ranked * x = a;
+    const t_ranked * y = b;
+
+    if (x->distance != y->distance)
+    {
+        return x->distance < y->distance ? -1 : 1;
+    }
+
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/*
+    a made-up fingerprint with random fields
+*/
+static void make_random(unsigned char * buffer, unsigned int * seed)
+{
+    short version = (short) fp_getversion(NULL);
+    int length = 12000 + (int) (next_random(seed) % 30000);
+    short fit = (short) (next_random(seed) % 3000);
+    short dom = (short) (500 + next_random(seed) % 5000);
+    int i;
+
+    memset(buffer, 0, FP_SIZE);
+    memcpy(buffer, &version, sizeof(version));
+    memcpy(buffer + FP_LENGTH_OFFSET, &length, sizeof(length));
+    memcpy(buffer + FP_FIT_OFFSET, &fit, sizeof(fit));
+    memcpy(buffer + FP_AVGDOM_OFFSET, &dom, sizeof(dom));
+
+    for (i = 0; i < FP_R_BYTES; i++)
+    {
+        buffer[FP_R_OFFSET + i] = (unsigned char) next_random(seed);
+    }
+    for (i = 0; i < FP_FRAMES; i++)
+    {
+        set_dom(buffer, i, (int) (next_random(seed) & 0x3F));
+    }
+}
+
+/*
+    a copy of a fingerprint with some fits and
+    dominant lines changed, and a small change
+    to the header
+*/
+static void make_near(unsigned char * buffer, const unsigned char * from, unsigned int * seed)
+{
+    int length;
+    short fit;
+    int i;
+
+    memcpy(buffer, from, FP_SIZE);
+    memcpy(&length, buffer + FP_LENGTH_OFFSET, sizeof(length));
+    memcpy(&fit, buffer + FP_FIT_OFFSET, sizeof(fit));
+    length += (int) (next_random(seed) % 41) - 20;
+    fit = (short) (fit + (int) (next_random(seed) % 101) - 50);
+    memcpy(buffer + FP_LENGTH_OFFSET, &length, sizeof(length));
+    memcpy(buffer + FP_FIT_OFFSET, &fit, sizeof(fit));
+
+    for (i = 0; i < 100; i++)
+    {
+        set_fit(buffer, (int) (next_random(seed) % FP_FRAMES),
+                (int) (next_random(seed) % (FP_R_FRAME * 4)), (int) (next_random(seed) & 3));
+    }
+    for (i = 0; i < 8; i++)
+    {
+        set_dom(buffer, (int) (next_random(seed) % FP_FRAMES), (int) (next_random(seed) & 0x3F));
+    }
+}
+
+static int get_header(const unsigned char * buffer, int offset, int size)
+{
+    int x;
+    short y;
+
+    if (size == sizeof(int))
+    {
+        memcpy(&x, buffer + offset, sizeof(x));
+        return x;
+    }
+
+    memcpy(&y, buffer + offset, sizeof(y));
+    return y;
+}
+
+/*
+    check fp_index_query against fp_compare on every
+    fingerprint: without tolerances every answer must
+    be right, in order, and no better than the true
+    k nearest, with the nearest found for copies;
+    with tolerances that take in few lengths it must
+    give exactly the k nearest of those in tolerance
+
+    output * 0 if all checks pass
+*/
+static int check_index(void)
+{
+    const int count = 3000, queries = 200, k = 10;
+    const int length_tolerance = 50, fit_tolerance = 200, avgdom_tolerance = 300;
+    unsigned char * fps = malloc((size_t) count * FP_SIZE);
+    unsigned char * query = malloc(FP_SIZE);
+    int * ids = malloc(sizeof(int) * count);
+    t_ranked * ranked = malloc(sizeof(t_ranked) * count);
+    int found_ids[10];
+    float found[10];
+    unsigned int seed = 11;
+    int failures = 0, checks = 0;
+    int i, j, q, n, tolerances;
+
+    /*
+        with copies, for ties to sort out
+    */
+    for (i = 0; i < count; i++)
+    {
+        if (i % 8 == 7)
+        {
+            memcpy(fps + (size_t) i * FP_SIZE, fps + (size_t) (next_random(&seed) % i) * FP_SIZE, FP_SIZE);
+        }
+        else
+        {
+            make_random(fps + (size_t) i * FP_SIZE, &seed);
+        }
+        ids[i] = 5 * i + 3;
+    }
+
+    t_fp_index * index = fp_index_build(fps, ids, count, 0);
+
+    if (index == NULL)
+    {
+        printf("Could not build the index\n");
+        return 1;
+    }
+
+    for (tolerances = 0; tolerances < 2; tolerances++)
+    {
+        if (tolerances)
+        {
+            fp_index_set_tolerances(index, length_tolerance, fit_tolerance, avgdom_tolerance);
+        }
+
+        for (q = 0; q < queries; q++)
+        {
+            int near = q % 2 == 0;
+            int source = (int) (next_random(&seed) % count);
+            int wanted = 0;
+
+            if (near)
+            {
+                make_near(query, fps + (size_t) source * FP_SIZE, &seed);
+            }
+            else
+            {
+                make_random(query, &seed);
+            }
+
+            for (i = 0; i < count; i++)
+            {
+                const unsigned char * fp = fps + (size_t) i * FP_SIZE;
+
+                if (tolerances
+                    && (abs(get_header(fp, FP_LENGTH_OFFSET, sizeof(int))
+                            - get_header(query, FP_LENGTH_OFFSET, sizeof(int))) > length_tolerance
+                        || abs(get_header(fp, FP_FIT_OFFSET, sizeof(short))
+                               - get_header(query, FP_FIT_OFFSET, sizeof(short))) > fit_tolerance
+                        || abs(get_header(fp, FP_AVGDOM_OFFSET, sizeof(short))
+                               - get_header(query, FP_AVGDOM_OFFSET, sizeof(short))) > avgdom_tolerance))
+                {
+                    continue;
+                }
+
+                ranked[wanted].distance = fp_compare(query, fp);
+                ranked[wanted].index = i;
+                wanted++;
+            }
+            qsort(ranked, wanted, sizeof(t_ranked), by_distance);
+            if (wanted > k)
+            {
+                wanted = k;
+            }
+
+            n = fp_index_query(index, query, k, found_ids, found);
+
+            checks++;
+
+            if (n < 0 || n > k || (tolerances && n != wanted))
+            {
+                printf("query %d%s: %d found, %d wanted\n", q, tolerances ? " in tolerance" : "", n, wanted);
+                failures++;
+                continue;
+            }
+
+            for (j = 0; j < n; j++)
+            {
+                int at = (found_ids[j] - 3) / 5;
+                int bad;
+
+                if (found_ids[j] < 3 || (found_ids[j] - 3) % 5 != 0 || at >= count)
+                {
+                    bad = 1;
+                }
+                else if (tolerances)
+                {
+                    bad = at != ranked[j].index || found[j] != ranked[j].distance;
+                }
+                else
+                {
+                    int before = j > 0 ? (found_ids[j - 1] - 3) / 5 : -1;
+
+                    bad = found[j] != fp_compare(query, fps + (size_t) at * FP_SIZE)
+                       || found[j] < ranked[j].distance
+                       || (j > 0 && (found[j] < found[j - 1]
+                                     || (found[j] == found[j - 1] && at < before)))
+                       || (near && j == 0 && at != ranked[0].index);
+                }
+
+                if (bad)
+                {
+                    printf("query %d%s: %d is %d at %.5f, nearest are %d at %.5f\n",
+                           q, tolerances ? " in tolerance" : "", j, found_ids[j], found[j],
+                           j < wanted ? ids[ranked[j].index] : -1,
+                           j < wanted ? ranked[j].distance : 0.0f);
+                    failures++;
+                    break;
+                }
+            }
+        }
+    }
+
+    printf("%d of %d checks passed\n", checks - failures, checks);
+
+    fp_index_free(index);
+    free(fps);
+    free(query);
+    free(ids);
+    free(ranked);
+
+    return failures == 0 ? 0 : 1;
+}
+
+/*
+    largest difference of a spectrum from a
+    reference, relative to the largest real or
+    imaginary part of the reference
+*/
+static float spectrum_error(const t_complex * x, const t_complex * ref, int n)
+{
+    float diff = 0.0f, peak = 0.0f;
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        diff = fmaxf(diff, fmaxf(fabsf(x[i].re - ref[i].re), fabsf(x[i].im - ref[i].im)));
+        peak = fmaxf(peak, fmaxf(fabsf(ref[i].re), fabsf(ref[i].im)));
+    }
+
+    return peak > 0.0f ? diff / peak : diff;
+}
+
+/*
+    check the FFT on random input at every size
+    up to a frame: the complex FFT at every
+    instruction set level against the scalar one,
+    and the real input FFT at every level against
+    the scalar complex FFT of the same samples
+
+    output * 0 if all are within FFT_TOLERANCE
+*/
+static int check_fft(void)
+{
+    static const char * levels[] = { "scalar", "SSE2", "AVX", "AVX-512" };
+    const int top = fft_simd_level();
+    unsigned int seed = 1;
+    int failures = 0, checks = 0;
+    int size, level, i;
+
+    printf("%6s %-8s %12s %12s\n", "size", "level", "complex", "real");
+
+    for (size = 16; size <= 8192; size *= 2)
+    {
+        t_complex * in = malloc(sizeof(t_complex) * size);
+        t_complex * ref = malloc(sizeof(t_complex) * size);
+        t_complex * real_ref = malloc(sizeof(t_complex) * size);
+        t_complex * out = malloc(sizeof(t_complex) * size);
+        t_fft_data * plan = fft_init(size);
+        t_fft_data * real_plan = rfft_init(size);
+
+        for (i = 0; i < size; i++)
+        {
+            in[i].re = (float) (next_random(&seed) & 0xFFFF) / 32768.0f - 1.0f;
+            in[i].im = (float) (next_random(&seed) & 0xFFFF) / 32768.0f - 1.0f;
+        }
+
+        /*
+            the references, by the scalar complex FFT,
+            of the input and of the size real samples
+            packed into its first size / 2 values
+        */
+        plan->simd = FFT_SCALAR;
+        memcpy(ref, in, sizeof(t_complex) * size);
+        fft(plan, ref);
+
+        for (i = 0; i < size; i++)
+        {
+            real_ref[i].re = (i & 1) ? in[i / 2].im : in[i / 2].re;
+            real_ref[i].im = 0.0f;
+        }
+        fft(plan, real_ref);
+
+        for (level = FFT_SCALAR; level <= top; level++)
+        {
+            float complex_error, real_error;
+
+            plan->simd = level;
+            memcpy(out, in, sizeof(t_complex) * size);
+            fft(plan, out);
+            complex_error = spectrum_error(out, ref, size);
+
+            real_plan->simd = level;
+            memcpy(out, in, sizeof(t_complex) * (size / 2));
+            rfft(real_plan, out);
+            real_error = spectrum_error(out, real_ref, size / 2);
+
+            printf("%6d %-8s %12.3g %12.3g\n", size, levels[level], complex_error, real_error);
+
+            failures += complex_error > FFT_TOLERANCE;
+            failures += real_error > FFT_TOLERANCE;
+            checks += 2;
+        }
+
+        fft_free(plan);
+        fft_free(real_plan);
+        free(in);
+        free(ref);
+        free(real_ref);
+        free(out);
+    }
+
+    printf("%d of %d checks within %g\n", checks - failures, checks, FFT_TOLERANCE);
+
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2)
+    {
+        printf("Usage: ./test filename.wav\n");
+        printf("       ./test -c filename.wav ...   compare exact and fast log\n");
+        printf("       ./test -s threads filename.wav ...   fingerprint on many threads at once\n");
+        printf("       ./test -b filename.wav ...   check batches against single handles\n");
+        printf("       ./test -d   check fp_compare_shifted on made-up fingerprints\n");
+        printf("       ./test -k   check fp_scan_topk against sorted fp_scan scores\n");
+        printf("       ./test -i   check fp_index_query against fp_compare on every fingerprint\n");
+        printf("       ./test -f   check the FFT at every instruction set level\n");
+        return 0;
+    }
+
+    if (strcmp(argv[1], "-s") == 0 && argc > 3)
+    {
+        return stress(atoi(argv[2]) > 0 ? atoi(argv[2]) : 1, argc - 3, argv + 3);
+    }
+
+    if (strcmp(argv[1], "-b") == 0)
+    {
+        return check_batch(argc - 2, argv + 2);
+    }
+
+    if (strcmp(argv[1], "-c") == 0)
+    {
+        return compare_logs(argc - 2, argv + 2);
+    }
+
+    if (strcmp(argv[1], "-d") == 0)
+    {
+        return check_shifts();
+    }
+
+    if (strcmp(argv[1], "-k") == 0)
+    {
+        return check_scan();
+    }
+
+    if (strcmp(argv[1], "-i") == 0)
+    {
+        return check_index();
+    }
+
+    if (strcmp(argv[1], "-f") == 0)
+    {
+        return check_fft();
+    }
+
+    unsigned char * buffer = malloc(fp_getsize(NULL));
+
+    int result = fingerprint_file(argv[1], 0, 1, buffer);
+
+    if (result < 0)
+    {
+        printf("Failed to calculate fingerprint\n");
+    }
+    else
+    {
+        int i;
+        for (i = 0; i < fp_getsize(NULL); i++)
+        {
+            if (!(i % 32))
+            {
+                printf("\n");
+            }
+
+            printf("%02x ", (int) buffer[i]);
+        }
+
+        printf("\n");
     }
 
     free(buffer);
-    fp_free(fooid);
-    free(data);
-    free(sfinfo);
 
     return 0;
 }
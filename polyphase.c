@@ -0,0 +1,378 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+/*
+    Polyphase decimator to 8000 Hz for input rates that
+    are a simple rational multiple of it (44100 = 8000 * 441/80,
+    48000 = 8000 * 6, ...).
+
+    Input that is already at 8000 Hz gets a single phase.
+    libresample does not pass it through untouched either,
+    it still applies its lowpass, so we do the same.
+
+    The filter is the same Kaiser windowed lowpass that
+    libresample uses, sampled at the exact output phases
+    and precomputed per phase. The taps are summed in the
+    same order as libresample's SrcUD, so for integer ratios
+    the output is identical to it. For other ratios it only
+    differs by libresample's own phase rounding.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "polyphase.h"
+#include "thread.h"
+#include "libresample/resample_defs.h"
+#include "libresample/resample.h"
+
+/*
+    largest number of phases we keep tables for
+*/
+#define MAX_PHASES      320
+
+/*
+    number of samplerates we keep shared tables for,
+    handles for any others get their own
+*/
+#define MAX_FILTERS     16
+
+/*
+    the lowpass and the phase tables only depend on the
+    samplerate, they are built once and never freed
+*/
+static t_mutex filter_lock = MUTEX_INITIALIZER;
+static float *lowpass_imp;
+static float *lowpass_impd;
+static int lowpass_nwing;
+static t_poly_filter *filters[MAX_FILTERS];
+
+static int gcd(int a, int b)
+{
+    int t;
+
+    while (b != 0) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/*
+    collect the coefficients for one wing at phase Ph,
+    stepping through the impulse response like FilterUD
+
+    output * number of taps
+*/
+static int get_wing(const float *Imp, int end, float Ph, float dh, int skip,
+                    float *c, int maxtaps)
+{
+    float Ho;
+    int n = 0;
+
+    Ho = Ph * dh;
+    if (skip) {
+        Ho += dh;
+    }
+
+    while ((int)Ho < end && n < maxtaps) {
+        c[n++] = Imp[(int)Ho];
+        Ho += dh;
+    }
+
+    return n;
+}
+
+/*
+    get libresample's lowpass, building it if needed,
+    filter_lock must be held
+
+    output * number of coefficients, 0 on failure
+*/
+static int lowpass_locked(void)
+{
+    if (lowpass_nwing == 0) {
+        lowpass_nwing = resample_make_filter(FALSE, &lowpass_imp, &lowpass_impd);
+    }
+
+    return lowpass_nwing;
+}
+
+/*
+    get the lowpass filter tables for resample_open_filter,
+    shared by every handle
+
+    output * number of coefficients, 0 on failure
+*/
+int get_lowpass(float **imp, float **impd)
+{
+    int nwing;
+
+    mutex_lock(&filter_lock);
+    nwing = lowpass_locked();
+    mutex_unlock(&filter_lock);
+
+    *imp  = lowpass_imp;
+    *impd = lowpass_impd;
+
+    return nwing;
+}
+
+static void filter_free(t_poly_filter *pf, const fp_allocator *mem)
+{
+    mem_free_aligned(mem, pf->nleft);
+    mem_free_aligned(mem, pf->nright);
+    mem_free_aligned(mem, pf->left);
+    mem_free_aligned(mem, pf->right);
+    mem_free_aligned(mem, pf);
+}
+
+/*
+    build the phase tables for decimating
+    from samplerate to 8000 Hz, shared ones
+    come from the system allocator (mem NULL),
+    those of a single handle from its own
+
+    output * tables (NULL on failure)
+*/
+static t_poly_filter* filter_init(const int samplerate, const float *Imp,
+                                  const int Nwing, const fp_allocator *mem)
+{
+    t_poly_filter *pf;
+    const int g = gcd(samplerate, 8000);
+    int p;
+    float factor, dh;
+
+    pf = (t_poly_filter*)mem_alloc_aligned(mem, sizeof(t_poly_filter));
+    if (pf == NULL) {
+        return NULL;
+    }
+    memset(pf, 0, sizeof(t_poly_filter));
+
+    pf->samplerate = samplerate;
+    pf->L = 8000 / g;
+    pf->M = samplerate / g;
+
+    /*
+        same ratio and filter as resample_open would use
+    */
+    factor = 8000.0f / (float)samplerate;
+    dh = MIN(Npc, factor * Npc);
+    pf->scale = factor;
+
+    pf->wing   = (int)(Nwing / dh) + 2;
+    pf->nleft  = (int*)mem_alloc_aligned(mem, sizeof(int) * pf->L);
+    pf->nright = (int*)mem_alloc_aligned(mem, sizeof(int) * pf->L);
+    pf->left   = (float*)mem_alloc_aligned(mem, sizeof(float) * pf->L * pf->wing);
+    pf->right  = (float*)mem_alloc_aligned(mem, sizeof(float) * pf->L * pf->wing);
+
+    if (pf->nleft == NULL || pf->nright == NULL
+        || pf->left == NULL || pf->right == NULL) {
+        filter_free(pf, mem);
+        return NULL;
+    }
+
+    for (p = 0; p < pf->L; p++) {
+        /*
+            left wing: distance p/L, right wing 1 - p/L,
+            the right one skips the center tap at phase 0
+            and drops the last coefficient
+        */
+        pf->nleft[p]  = get_wing(Imp, Nwing, (float)p / (float)pf->L, dh, FALSE,
+                                 &(pf->left[p * pf->wing]), pf->wing);
+        pf->nright[p] = get_wing(Imp, Nwing - 1,
+                                 p == 0 ? 0.0f : (float)(pf->L - p) / (float)pf->L,
+                                 dh, p == 0,
+                                 &(pf->right[p * pf->wing]), pf->wing);
+    }
+
+    return pf;
+}
+
+/*
+    set up decimation from samplerate to 8000 Hz
+
+    output * state (NULL if samplerate is not supported)
+*/
+t_polyphase* poly_open(const int samplerate, const fp_allocator *mem)
+{
+    t_polyphase *pp;
+    int i;
+
+    if (samplerate < 8000 || 8000 / gcd(samplerate, 8000) > MAX_PHASES) {
+        return NULL;
+    }
+
+    pp = (t_polyphase*)mem_calloc(mem, 1, sizeof(t_polyphase));
+    if (pp == NULL) {
+        return NULL;
+    }
+
+    pp->mem = *mem;
+
+    /*
+        find or build the tables for this samplerate
+    */
+    mutex_lock(&filter_lock);
+
+    for (i = 0; i < MAX_FILTERS && filters[i] != NULL; i++) {
+        if (filters[i]->samplerate == samplerate) {
+            pp->filter = filters[i];
+            break;
+        }
+    }
+
+    if (pp->filter == NULL && lowpass_locked() != 0) {
+        if (i < MAX_FILTERS) {
+            filters[i] = filter_init(samplerate, lowpass_imp, lowpass_nwing, NULL);
+            pp->filter = filters[i];
+        } else {
+            pp->own_filter = filter_init(samplerate, lowpass_imp, lowpass_nwing, &(pp->mem));
+            pp->filter = pp->own_filter;
+        }
+    }
+
+    mutex_unlock(&filter_lock);
+
+    if (pp->filter == NULL) {
+        mem_free(mem, pp);
+        return NULL;
+    }
+
+    /*
+        room for the filter reach on both sides
+        plus a good chunk of new input
+    */
+    pp->xsize = 2 * pp->filter->wing + IN_LEN;
+    pp->x     = (float*)mem_alloc_aligned(mem, sizeof(float) * pp->xsize);
+
+    if (pp->x == NULL) {
+        poly_close(pp);
+        return NULL;
+    }
+
+    poly_reset(pp);
+
+    return pp;
+}
+
+/*
+    drop all input history
+*/
+void poly_reset(t_polyphase *pp)
+{
+    /*
+        start with silence before the first sample
+    */
+    memset(pp->x, 0, sizeof(float) * pp->filter->wing);
+    pp->xlen  = pp->filter->wing;
+    pp->ipos  = pp->filter->wing;
+    pp->phase = 0;
+}
+
+/*
+    resample a block of input
+
+    input  * state
+           * input samples and their number
+           * returns the number of input samples used
+           * output buffer and its size
+
+    output * number of samples written
+*/
+int poly_process(t_polyphase *pp, const float *in, int inlen, int *inused,
+                 float *out, int outlen)
+{
+    const t_poly_filter *pf = pp->filter;
+    const int wing = pf->wing;
+    int outcount = 0;
+    int used = 0;
+    int m, n, shift;
+    const float *c;
+    const float *xp;
+    float v, r;
+
+    for (;;) {
+        /*
+            produce everything the buffered input allows
+        */
+        while (outcount < outlen && pp->ipos + wing < pp->xlen) {
+            xp = &(pp->x[pp->ipos]);
+
+            c = &(pf->left[pp->phase * wing]);
+            n = pf->nleft[pp->phase];
+            v = 0.0f;
+            for (m = 0; m < n; m++) {
+                v += c[m] * xp[-m];
+            }
+
+            c = &(pf->right[pp->phase * wing]);
+            n = pf->nright[pp->phase];
+            r = 0.0f;
+            for (m = 0; m < n; m++) {
+                r += c[m] * xp[m + 1];
+            }
+
+            v += r;
+            v *= pf->scale;
+
+            out[outcount++] = v;
+
+            pp->phase += pf->M;
+            pp->ipos  += pp->phase / pf->L;
+            pp->phase  = pp->phase % pf->L;
+        }
+
+        if (outcount == outlen || used == inlen) {
+            break;
+        }
+
+        /*
+            drop history the filter can no longer reach
+        */
+        shift = pp->ipos - wing;
+        if (shift > 0) {
+            memmove(pp->x, &(pp->x[shift]), sizeof(float) * (pp->xlen - shift));
+            pp->xlen -= shift;
+            pp->ipos -= shift;
+        }
+
+        /*
+            take in more input
+        */
+        n = MIN(inlen - used, pp->xsize - pp->xlen);
+        memcpy(&(pp->x[pp->xlen]), &in[used], sizeof(float) * n);
+        pp->xlen += n;
+        used     += n;
+    }
+
+    *inused = used;
+
+    return outcount;
+}
+
+void poly_close(t_polyphase *pp)
+{
+    fp_allocator mem = pp->mem;
+
+    if (pp->own_filter != NULL) {
+        filter_free(pp->own_filter, &mem);
+    }
+    mem_free_aligned(&mem, pp->x);
+    mem_free(&mem, pp);
+}
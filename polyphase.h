@@ -0,0 +1,86 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef POLYPHASE_H
+#define POLYPHASE_H
+
+/*
+    defs
+*/
+typedef struct
+{
+    int samplerate;
+
+    /*
+        input advances M / L samples per output
+    */
+    int L;
+    int M;
+
+    /*
+        filter taps per phase, left wing applies to
+        the current input sample and backwards,
+        right wing to the following ones
+    */
+    int wing;
+    int *nleft;
+    int *nright;
+    float *left;
+    float *right;
+    float scale;
+}
+t_poly_filter;
+
+typedef struct
+{
+    /*
+        phase tables, normally shared between
+        all handles with the same samplerate
+    */
+    const t_poly_filter *filter;
+    t_poly_filter *own_filter;
+
+    /*
+        allocator of the handle this belongs to
+    */
+    fp_allocator mem;
+
+    /*
+        input history
+    */
+    float *x;
+    int xsize;
+    int xlen;
+
+    /*
+        position of the next output
+    */
+    int ipos;
+    int phase;
+}
+t_polyphase;
+
+/*
+    funcs
+*/
+int get_lowpass(float **imp, float **impd);
+t_polyphase* poly_open(const int samplerate, const fp_allocator *mem);
+void poly_reset(t_polyphase *pp);
+int poly_process(t_polyphase *pp, const float *in, int inlen, int *inused,
+                 float *out, int outlen);
+void poly_close(t_polyphase *pp);
+
+#endif
@@ -0,0 +1,85 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+
+#ifndef PREFIX_H
+#define PREFIX_H
+
+/*
+    the library's internal functions are not static,
+    as they are shared between its files, so give them
+    all a fooid_ prefix to keep them from clashing
+    with those of the program linking it (fft, rfft,
+    mem_alloc, ...)
+
+    only fp_* is meant to be called from outside
+*/
+#define bitlen              fooid_bitlen
+#define mem_set_allocator   fooid_mem_set_allocator
+#define mem_alloc           fooid_mem_alloc
+#define mem_calloc          fooid_mem_calloc
+#define mem_free            fooid_mem_free
+#define mem_alloc_aligned   fooid_mem_alloc_aligned
+#define mem_free_aligned    fooid_mem_free_aligned
+#define table_alloc         fooid_table_alloc
+#define table_free          fooid_table_free
+
+#define sound_start_short   fooid_sound_start_short
+#define sound_start_float   fooid_sound_start_float
+#define downmix_short       fooid_downmix_short
+#define downmix_float       fooid_downmix_float
+
+#define get_lowpass         fooid_get_lowpass
+#define poly_open           fooid_poly_open
+#define poly_reset          fooid_poly_reset
+#define poly_process        fooid_poly_process
+#define poly_close          fooid_poly_close
+
+#define fft_init            fooid_fft_init
+#define fft_free            fooid_fft_free
+#define fft                 fooid_fft
+#define rfft_init           fooid_rfft_init
+#define rfft                fooid_rfft
+#define fft_get_plan        fooid_fft_get_plan
+#define rfft_get_plan       fooid_rfft_get_plan
+#define fft_simd_level      fooid_fft_simd_level
+#define radix_2_step_sse2   fooid_radix_2_step_sse2
+#define L_block1_sse2       fooid_L_block1_sse2
+#define L_block_sse2        fooid_L_block_sse2
+#define L_block_avx         fooid_L_block_avx
+#define L_block_avx512      fooid_L_block_avx512
+
+#define get_dbpower_fast    fooid_get_dbpower_fast
+#define init_dom_codes      fooid_init_dom_codes
+#define init_band_regress   fooid_init_band_regress
+#define band_regress        fooid_band_regress
+
+#define compare_simd_level  fooid_compare_simd_level
+#define r_distance_bound    fooid_r_distance_bound
+#define r_distance          fooid_r_distance
+#define dom_distance        fooid_dom_distance
+#define compare_bound       fooid_compare_bound
+#define get_short           fooid_get_short
+#define get_int             fooid_get_int
+#define sift_down           fooid_sift_down
+#define sift_up             fooid_sift_up
+#define heap_sort           fooid_heap_sort
+
+#define get_frame_tables    fooid_get_frame_tables
+#define analyse_frame       fooid_analyse_frame
+#define get_params          fooid_get_params
+
+#endif
@@ -14,69 +14,286 @@
     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 */
 
+
+/*
+    Linear regression of the dB spectrum in each Bark band.
+
+    http://mathworld.wolfram.com/LeastSquaresFitting.html
+
+    The x side of the fit only depends on the band size and
+    is worked out once. The y sums of all bands are then
+    taken in one sweep, 4 bands side by side in vector lanes.
+    Every band still sums its lines one by one, in order,
+    so the fits are exactly those of a band-by-band loop.
+*/
+
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include "common.h"
+#include "regress.h"
+
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+                          || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define REGRESS_SSE2
+#include <emmintrin.h>
+#endif
 
 /*
-    http://mathworld.wolfram.com/LeastSquaresFitting.html
-*/
+    set up the x statistics of every band and the
+    order in which the sweep visits the bands
 
-void do_linear_regress(float *dbspec, int len, float *r)
+    input  * tables with the Bark bands filled in
+*/
+void init_band_regress(t_frame_tables *ft)
 {
-    int i;
-    float ssx;
-    float ssy;
-    float sxy;
-
-    float ssxx;
-    float ssyy;
-    float ssxy;
+    int load[SWEEP_LANES];
+    int lane_bands[SWEEP_LANES][MAX_BARK];
+    int lane_count[SWEEP_LANES];
+    int cur[SWEEP_LANES];
+    int done[SWEEP_LANES];
+    int used[MAX_BARK];
+    int i, j, l, len, best;
+    int t, next;
+    float avx, ssx;
 
-    float avx;
-    float avy;
+    for (j = 1; j < ft->max_sfb; j++) {
+        len = ft->cb_size[j];
+        avx = 0.0f;
+        ssx = 0.0f;
 
-    float rsq;
-    /* float b, a; */
+        for (i = 0; i < len; i++) {
+            avx += i;
+            ssx += i * i;
+        }
 
-    ssx = 0.0f;
-    ssy = 0.0f;
-    sxy = 0.0f;
-    avx = 0.0f;
-    avy = 0.0f;
+        avx /= (float)len;
 
-    for (i = 0; i < len; i++) {
-        avx += i;
-        avy += dbspec[i];
+        ft->lenavx[j] = (float)len * avx;
+        ft->ssxx[j]   = ssx - ft->lenavx[j] * avx;
+    }
 
-        ssx  += i * i;
-        ssy  += dbspec[i] * dbspec[i];
-        sxy  += i * dbspec[i];
+    /*
+        largest band first onto the least loaded lane,
+        so the lanes finish at about the same time
+    */
+    for (l = 0; l < SWEEP_LANES; l++) {
+        load[l] = 0;
+        lane_count[l] = 0;
+    }
+    for (j = 0; j < MAX_BARK; j++) {
+        used[j] = FALSE;
     }
 
-    avx /= (float)len;
-    avy /= (float)len;
+    for (i = 1; i < ft->max_sfb; i++) {
+        best = -1;
+        for (j = 1; j < ft->max_sfb; j++) {
+            if (!used[j] && (best < 0 || ft->cb_size[j] > ft->cb_size[best])) {
+                best = j;
+            }
+        }
+        used[best] = TRUE;
 
-    ssxx = ssx - (float)len * avx * avx;
-    ssyy = ssy - (float)len * avy * avy;
-    ssxy = sxy - (float)len * avx * avy;
+        l = 0;
+        for (j = 1; j < SWEEP_LANES; j++) {
+            if (load[j] < load[l]) {
+                l = j;
+            }
+        }
 
-    if (ssyy <= 0.0f + EPSILON) {
-        *r = 1.0f;
+        lane_bands[l][lane_count[l]++] = best;
+        load[l] += ft->cb_size[best];
     }
 
     /*
-        b = ssxy / ssxx;
-        a = avy - b * avx;
+        cut the sweep where any lane moves on to its
+        next band, lanes that are out of bands idle
+        on line 0 and never store anything
     */
-    rsq = (ssxy * ssxy) / (ssxx * ssyy);
+    for (l = 0; l < SWEEP_LANES; l++) {
+        cur[l] = 0;
+        done[l] = 0;
+    }
 
-    /*
-        It seems that rsq ^ 0.25 follows roughly
-        a normal distribution, so thats our preferred
-        way of looking at things
-    */
-    *r = (float)sqrt(sqrt(rsq));
+    ft->nphases = 0;
+    t = 0;
+
+    for (;;) {
+        next = -1;
+        for (l = 0; l < SWEEP_LANES; l++) {
+            if (cur[l] < lane_count[l]) {
+                int end = done[l] + ft->cb_size[lane_bands[l][cur[l]]];
+                if (next < 0 || end < next) {
+                    next = end;
+                }
+            }
+        }
+
+        if (next < 0) {
+            break;
+        }
+
+        assert(ft->nphases < SWEEP_PHASES);
+
+        {
+            t_sweep_phase *ph = &(ft->phases[ft->nphases++]);
+
+            ph->len = next - t;
+
+            for (l = 0; l < SWEEP_LANES; l++) {
+                if (cur[l] < lane_count[l]) {
+                    j = lane_bands[l][cur[l]];
+                    ph->pos[l] = ft->cb_start[j] + (t - done[l]);
+                    ph->x[l] = (float)(t - done[l]);
+
+                    if (done[l] + ft->cb_size[j] == next) {
+                        ph->band[l] = j;
+                        done[l] = next;
+                        cur[l]++;
+                    } else {
+                        ph->band[l] = -1;
+                    }
+                } else {
+                    ph->pos[l] = 0;
+                    ph->x[l] = 0.0f;
+                    ph->band[l] = -1;
+                }
+            }
+        }
+
+        t = next;
+    }
+}
+
+/*
+    correlation of a band from its sums,
+    rsq ^ 0.25 follows roughly a normal distribution,
+    so thats our preferred way of looking at things
+*/
+static float band_fit(const t_frame_tables *ft, const int band,
+                      const float sy, const float syy, const float sxy)
+{
+    const float len = (float)ft->cb_size[band];
+    float avy;
+    float ssyy;
+    float ssxy;
+    float rsq;
+
+    avy = sy / len;
+
+    ssyy = syy - len * avy * avy;
+    ssxy = sxy - ft->lenavx[band] * avy;
+
+    rsq = (ssxy * ssxy) / (ft->ssxx[band] * ssyy);
+
+    return (float)sqrt(sqrt(rsq));
+}
+
+/*
+    fit a line to every band but the first
+
+    input  * analysis tables
+           * dB power spectrum
+           * output, fits for bands 1 to max_sfb - 1
+*/
+void band_regress(const t_frame_tables *ft, const float *dbpower, float *r)
+{
+#if defined(REGRESS_SSE2)
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 sy  = _mm_setzero_ps();
+    __m128 syy = _mm_setzero_ps();
+    __m128 sxy = _mm_setzero_ps();
+    float ly[SWEEP_LANES], lyy[SWEEP_LANES], lxy[SWEEP_LANES];
+    int p, k, l;
+
+    for (p = 0; p < ft->nphases; p++) {
+        const t_sweep_phase *ph = &(ft->phases[p]);
+        const float *y0 = dbpower + ph->pos[0];
+        const float *y1 = dbpower + ph->pos[1];
+        const float *y2 = dbpower + ph->pos[2];
+        const float *y3 = dbpower + ph->pos[3];
+        __m128 x = _mm_loadu_ps(ph->x);
+        __m128 c0, c1, c2, c3;
+        __m128 clear;
+
+/*
+    one line of each lane's band
+*/
+#define SWEEP_STEP(y)                                       \
+        do {                                                \
+            sy  = _mm_add_ps(sy, y);                        \
+            syy = _mm_add_ps(syy, _mm_mul_ps(y, y));        \
+            sxy = _mm_add_ps(sxy, _mm_mul_ps(x, y));        \
+            x   = _mm_add_ps(x, one);                       \
+        } while (0)
+
+        /*
+            4 lines of each lane at a time, turned
+            into 4 steps of all lanes
+        */
+        for (k = 0; k + 4 <= ph->len; k += 4) {
+            c0 = _mm_loadu_ps(y0 + k);
+            c1 = _mm_loadu_ps(y1 + k);
+            c2 = _mm_loadu_ps(y2 + k);
+            c3 = _mm_loadu_ps(y3 + k);
+            _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+            SWEEP_STEP(c0);
+            SWEEP_STEP(c1);
+            SWEEP_STEP(c2);
+            SWEEP_STEP(c3);
+        }
+
+        for (; k < ph->len; k++) {
+            c0 = _mm_setr_ps(y0[k], y1[k], y2[k], y3[k]);
+            SWEEP_STEP(c0);
+        }
+
+#undef SWEEP_STEP
+
+        /*
+            finish the bands that end here and
+            start their lanes over
+        */
+        _mm_storeu_ps(ly, sy);
+        _mm_storeu_ps(lyy, syy);
+        _mm_storeu_ps(lxy, sxy);
+
+        for (l = 0; l < SWEEP_LANES; l++) {
+            if (ph->band[l] >= 0) {
+                r[ph->band[l]] = band_fit(ft, ph->band[l], ly[l], lyy[l], lxy[l]);
+            }
+        }
+
+        clear = _mm_castsi128_ps(_mm_setr_epi32(ph->band[0] >= 0 ? -1 : 0,
+                                                ph->band[1] >= 0 ? -1 : 0,
+                                                ph->band[2] >= 0 ? -1 : 0,
+                                                ph->band[3] >= 0 ? -1 : 0));
+        sy  = _mm_andnot_ps(clear, sy);
+        syy = _mm_andnot_ps(clear, syy);
+        sxy = _mm_andnot_ps(clear, sxy);
+    }
+#else
+    int i, j, len;
+    const float *y;
+    float sy, syy, sxy;
+
+    for (j = 1; j < ft->max_sfb; j++) {
+        y = dbpower + ft->cb_start[j];
+        len = ft->cb_size[j];
+
+        sy  = 0.0f;
+        syy = 0.0f;
+        sxy = 0.0f;
+
+        for (i = 0; i < len; i++) {
+            sy  += y[i];
+            syy += y[i] * y[i];
+            sxy += i * y[i];
+        }
+
+        r[j] = band_fit(ft, j, sy, syy, sxy);
+    }
+#endif
 }
@@ -17,6 +17,9 @@
 #ifndef REGRESS_H
 #define REGRESS_H
 
-void do_linear_regress(float *dbspec, int len, float *r);
+#include "common.h"
+
+void init_band_regress(t_frame_tables *ft);
+void band_regress(const t_frame_tables *ft, const float *dbpower, float *r);
 
 #endif
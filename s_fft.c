@@ -19,25 +19,39 @@
 #include <assert.h>
 #include <math.h>
 #include "s_fft.h"
+#include "s_fft_simd.h"
 #include "common.h"
+#include "thread.h"
+
+/*
+    process wide tables, indexed by bitlen(size - 1)
+    they are never modified once built
+*/
+#define MAX_PLANS   32
+
+static t_mutex plan_lock = MUTEX_INITIALIZER;
+static t_fft_data *cplx_plans[MAX_PLANS];
+static t_fft_data *real_plans[MAX_PLANS];
 
 t_fft_data* fft_init(const int fftsize)
 {
     const int tabsize = fftsize;
     int i, j;
     int powlen, logb_n;
+    int n4, trigexp;
     float e, theta;
+    t_complex *w1, *w3;
     t_fft_data *tb;
 
     /*
         allocate structure memory
     */
-    tb = (t_fft_data*)malloc(sizeof(t_fft_data));
+    tb = (t_fft_data*)table_alloc(sizeof(t_fft_data));
 
     /*
         init trig tables
     */
-    tb->twiddle_tab  = (t_twiddle*)malloc(sizeof(t_twiddle) * tabsize);
+    tb->twiddle_tab  = (t_twiddle*)table_alloc(sizeof(t_twiddle) * tabsize);
 
     e = (2.0f * PI) / (float)fftsize;
     for (i = 0; i < tabsize; i++) {
@@ -58,7 +72,7 @@ t_fft_data* fft_init(const int fftsize)
         logb_n++;
     }
 
-    tb->seed_tab = (unsigned*)malloc(sizeof(unsigned) * (1 << logb_n));
+    tb->seed_tab = (unsigned*)table_alloc(sizeof(unsigned) * (1 << logb_n));
 
     tb->seed_tab[0] = 0;
     tb->seed_tab[1] = 1;
@@ -70,31 +84,53 @@ t_fft_data* fft_init(const int fftsize)
         }
     }
 
+    /*
+        per stage twiddles for the L-step, the stage with
+        n4 butterflies per block starts at 2 * (n4 - 1)
+    */
+    tb->stage_tab = (t_complex*)table_alloc(sizeof(t_complex) * tabsize);
+
+    for (n4 = 1; n4 <= (fftsize >> 2); n4 <<= 1) {
+        trigexp = fftsize / (n4 << 2);
+        w1 = &(tb->stage_tab[2 * (n4 - 1)]);
+        w3 = w1 + n4;
+
+        for (j = 0; j < n4; j++) {
+            w1[j].re = tb->twiddle_tab[j * trigexp].cos_t;
+            w1[j].im = tb->twiddle_tab[j * trigexp].sin_t;
+            w3[j].re = tb->twiddle_tab[j * trigexp].cos3_t;
+            w3[j].im = tb->twiddle_tab[j * trigexp].sin3_t;
+        }
+    }
+
     /*
         store size (mostly for error checks)
     */
     tb->size = fftsize;
+    tb->rtwiddle_tab = NULL;
 
     /*
-        allocate work buffers
+        pick butterfly kernels for this CPU
     */
-    tb->work = (t_complex*)malloc(sizeof(t_complex) * fftsize);
+    tb->simd = fft_simd_level();
 
     return tb;
 }
 
 void fft_free(t_fft_data *tb)
 {
-    free(tb->twiddle_tab);
-    free(tb->seed_tab);
-    free(tb->work);
+    table_free(tb->twiddle_tab);
+    table_free(tb->seed_tab);
+    table_free(tb->rtwiddle_tab);
+    table_free(tb->stage_tab);
 
     tb->twiddle_tab = NULL;
     tb->seed_tab = NULL;
-    tb->work = NULL;
+    tb->rtwiddle_tab = NULL;
+    tb->stage_tab = NULL;
     tb->size = 0;
 
-    free(tb);
+    table_free(tb);
 }
 
 
@@ -305,11 +341,59 @@ static void L_step(const t_fft_data *tb, t_complex *x)
     }
 }
 
+#if defined(FFT_X86)
+/*
+    L-butterflies, block by block, so that all the
+    butterflies of a block are contiguous in memory
+    and can be handed to the vector kernels
+*/
+static void L_step_simd(const t_fft_data *tb, t_complex *x)
+{
+    const int size = tb->size;
+    int N2, N4;
+    int i0, i_s, i_i;
+    const t_complex *w1, *w3;
+
+    for (N2 = 4; N2 <= size; N2 <<= 1) {
+        N4 = N2 >> 2;
+        w1 = &(tb->stage_tab[2 * (N4 - 1)]);
+        w3 = w1 + N4;
+
+        i_s = 0;
+        i_i = N2 << 1;
+
+        do {
+            for (i0 = i_s; i0 < size; i0 += i_i) {
+                if (N4 >= 8 && tb->simd >= FFT_AVX512) {
+                    L_block_avx512(&x[i0], w1, w3, N4);
+                } else if (N4 >= 4 && tb->simd >= FFT_AVX) {
+                    L_block_avx(&x[i0], w1, w3, N4);
+                } else if (N4 >= 2) {
+                    L_block_sse2(&x[i0], w1, w3, N4);
+                } else {
+                    L_block1_sse2(&x[i0]);
+                }
+            }
+            i_s = (i_i << 1) - N2;
+            i_i <<= 2;
+        } while (i_s < size);
+    }
+}
+#endif
+
 /*
     assumes bitreversed input
 */
 static void fft_proc_split(const t_fft_data *tb, t_complex *x)
 {
+#if defined(FFT_X86)
+    if (tb->simd != FFT_SCALAR && tb->size >= 4) {
+        radix_2_step_sse2(tb, x);
+        L_step_simd(tb, x);
+        return;
+    }
+#endif
+
     /*
         radix-2 first step
     */
@@ -331,3 +415,126 @@ void fft(const t_fft_data *tb, t_complex *x)
     fast_reorder(tb, x);
     fft_proc_split(tb, x);
 }
+
+/*
+    set up tables for a real input FFT of fftsize
+    points, done as a complex FFT of half the size
+*/
+t_fft_data* rfft_init(const int fftsize)
+{
+    const int halfsize = fftsize >> 1;
+    int i;
+    float e, theta;
+    t_fft_data *tb;
+
+    tb = fft_init(halfsize);
+
+    /*
+        twiddles for splitting the half size result
+        into the even and odd parts, only the first
+        quarter is needed due to symmetry
+    */
+    tb->rtwiddle_tab = (t_complex*)table_alloc(sizeof(t_complex) * ((halfsize >> 1) + 1));
+
+    e = (2.0f * PI) / (float)fftsize;
+    for (i = 0; i <= (halfsize >> 1); i++) {
+        theta = e * (float) i;
+        tb->rtwiddle_tab[i].re = (float)cos(theta);
+        tb->rtwiddle_tab[i].im = (float)sin(theta);
+    }
+
+    return tb;
+}
+
+/*
+    real input FFT
+
+    input is 2 * tb->size real samples, packed as
+    tb->size complex values (even samples in re,
+    odd samples in im)
+
+    output is the lower half of the spectrum, bins
+    0 to tb->size - 1, the Nyquist bin is dropped
+*/
+void rfft(const t_fft_data *tb, t_complex *x)
+{
+    const int halfsize = tb->size;
+    int k;
+    float Er, Ei, Or, Oi, Tr, Ti;
+    float CC, SS;
+
+    assert(tb != NULL);
+    assert(tb->rtwiddle_tab != NULL);
+
+    fft(tb, x);
+
+    /*
+        DC is purely real
+    */
+    x[0].re = x[0].re + x[0].im;
+    x[0].im = 0.0f;
+
+    for (k = 1; k <= (halfsize >> 1); k++) {
+        /*
+            separate the spectra of the even and
+            odd samples
+        */
+        Er = 0.5f * (x[k].re + x[halfsize - k].re);
+        Ei = 0.5f * (x[k].im - x[halfsize - k].im);
+        Or = 0.5f * (x[k].im + x[halfsize - k].im);
+        Oi = 0.5f * (x[halfsize - k].re - x[k].re);
+
+        /*
+            rotate the odd part
+        */
+        CC = tb->rtwiddle_tab[k].re;
+        SS = tb->rtwiddle_tab[k].im;
+
+        Tr = Or * CC + Oi * SS;
+        Ti = Oi * CC - Or * SS;
+
+        x[k].re = Er + Tr;
+        x[k].im = Ei + Ti;
+        x[halfsize - k].re =   Er - Tr;
+        x[halfsize - k].im = -(Ei - Ti);
+    }
+}
+
+static const t_fft_data* get_plan(t_fft_data **plans, const int fftsize,
+                                  t_fft_data* (*plan_init)(const int))
+{
+    const int idx = bitlen(fftsize - 1);
+    t_fft_data *tb;
+
+    assert(idx < MAX_PLANS);
+
+    mutex_lock(&plan_lock);
+    if (plans[idx] == NULL) {
+        plans[idx] = plan_init(fftsize);
+    }
+    tb = plans[idx];
+    mutex_unlock(&plan_lock);
+
+    return tb;
+}
+
+/*
+    shared, read-only tables for a complex FFT of fftsize
+    points, built on first use and kept for the lifetime
+    of the process
+
+    callers provide their own work buffers, so the
+    result can be used from any number of threads
+*/
+const t_fft_data* fft_get_plan(const int fftsize)
+{
+    return get_plan(cplx_plans, fftsize, fft_init);
+}
+
+/*
+    as above, for a real input FFT of fftsize points
+*/
+const t_fft_data* rfft_get_plan(const int fftsize)
+{
+    return get_plan(real_plans, fftsize, rfft_init);
+}
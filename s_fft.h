@@ -16,6 +16,9 @@
 
 #ifndef S_FFT_DEFINED
 #define S_FFT_DEFINED
+
+#include "prefix.h"
+
 /*
     defs
 */
@@ -46,9 +49,21 @@ typedef struct
     unsigned *seed_tab;
 
     /*
-        work buffers
+        real transform post-processing
+        (NULL for complex-only tables)
+    */
+    t_complex *rtwiddle_tab;
+
+    /*
+        twiddles rearranged per L-step stage, so that the
+        vector butterflies can load them contiguously
     */
-    t_complex *work;
+    t_complex *stage_tab;
+
+    /*
+        butterfly kernels to use (FFT_SCALAR, ...)
+    */
+    int simd;
 }
 t_fft_data;
 
@@ -58,11 +73,10 @@ t_fft_data;
 t_fft_data* fft_init(const int fftsize);
 void fft_free(t_fft_data *tb);
 void fft(const t_fft_data *tb, t_complex *x);
-
-/*
-    globals
-*/
-extern t_fft_data *xtb;
+t_fft_data* rfft_init(const int fftsize);
+void rfft(const t_fft_data *tb, t_complex *x);
+const t_fft_data* fft_get_plan(const int fftsize);
+const t_fft_data* rfft_get_plan(const int fftsize);
 
 #endif
 
@@ -0,0 +1,296 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+/*
+    Vector versions of the split-radix butterflies.
+
+    All kernels do exactly the same multiplies and adds,
+    in the same order, as the scalar code in s_fft.c.
+    There is deliberately no FMA contraction, so every
+    instruction set produces bit-identical spectra and
+    fingerprints do not depend on the machine they were
+    computed on.
+
+    Data stays in the interleaved t_complex layout.
+*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include "s_fft.h"
+#include "s_fft_simd.h"
+
+#if defined(FFT_X86)
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define TARGET(x) __attribute__((target(x)))
+#else
+#define TARGET(x)
+#endif
+
+/*
+    find the best kernels the CPU and OS support
+*/
+int fft_simd_level(void)
+{
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        return FFT_AVX512;
+    }
+    if (__builtin_cpu_supports("avx")) {
+        return FFT_AVX;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return FFT_SSE2;
+    }
+    return FFT_SCALAR;
+#elif defined(_MSC_VER)
+    int info[4];
+    unsigned __int64 xcr0 = 0;
+
+    __cpuid(info, 0);
+    if (info[0] < 1) {
+        return FFT_SCALAR;
+    }
+
+    __cpuid(info, 1);
+
+    /*
+        OS saves the AVX state?
+    */
+    if ((info[2] & (1 << 27)) != 0) {
+        xcr0 = _xgetbv(0);
+    }
+
+    if ((info[2] & (1 << 28)) != 0 && (xcr0 & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        if ((info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6) {
+            return FFT_AVX512;
+        }
+        return FFT_AVX;
+    }
+
+    __cpuid(info, 1);
+    if ((info[3] & (1 << 26)) != 0) {
+        return FFT_SSE2;
+    }
+    return FFT_SCALAR;
+#else
+    return FFT_SCALAR;
+#endif
+}
+
+/*
+    radix-2 first step, both points of a butterfly
+    fit in one SSE register
+*/
+TARGET("sse2")
+void radix_2_step_sse2(const t_fft_data *tb, t_complex *x)
+{
+    const int size = tb->size;
+    const __m128 hineg = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0x80000000, 0, 0));
+    int i0, i_s, i_i;
+    __m128 v, sw;
+
+    i_s = 0;
+    i_i = 4;
+
+    do {
+        for (i0 = i_s; i0 < size; i0 += i_i) {
+            /*
+                [a, b] -> [a + b, -b + a]
+            */
+            v  = _mm_loadu_ps((float*)&x[i0]);
+            sw = _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2));
+            v  = _mm_add_ps(_mm_xor_ps(v, hineg), sw);
+            _mm_storeu_ps((float*)&x[i0], v);
+        }
+        i_s = (i_i << 1) - 2;
+        i_i <<= 2;
+    } while (i_s < size);
+}
+
+/*
+    first L-step stage, the four legs of a block
+    are single neighbouring values and all twiddles
+    are trivial
+*/
+TARGET("sse2")
+void L_block1_sse2(t_complex *x)
+{
+    const __m128 hineg = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0x80000000, 0, 0));
+    const __m128 imneg = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0, 0, 0));
+    __m128 v01 = _mm_loadu_ps((float*)&x[0]);
+    __m128 v23 = _mm_loadu_ps((float*)&x[2]);
+    __m128 sw;
+
+    /*
+        [x2, x3] -> [x2 + x3, -i * (x2 - x3)]
+    */
+    sw  = _mm_shuffle_ps(v23, v23, _MM_SHUFFLE(1, 0, 3, 2));
+    v23 = _mm_add_ps(_mm_xor_ps(v23, hineg), sw);
+    v23 = _mm_xor_ps(_mm_shuffle_ps(v23, v23, _MM_SHUFFLE(2, 3, 1, 0)), imneg);
+
+    _mm_storeu_ps((float*)&x[0], _mm_add_ps(v01, v23));
+    _mm_storeu_ps((float*)&x[2], _mm_sub_ps(v01, v23));
+}
+
+/*
+    one block of L-shaped butterflies
+
+    x[0..n4), x[n4..2n4), x[2n4..3n4), x[3n4..4n4)
+    are the four legs, w1 and w3 the twiddles for
+    each position in the block
+*/
+TARGET("sse2")
+void L_block_sse2(t_complex *x, const t_complex *w1, const t_complex *w3, const int n4)
+{
+    float *p0 = (float*)(x);
+    float *p1 = (float*)(x + n4);
+    float *p2 = (float*)(x + 2 * n4);
+    float *p3 = (float*)(x + 3 * n4);
+    const __m128 imneg = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0, 0x80000000, 0));
+    const __m128 reneg = _mm_castsi128_ps(_mm_set_epi32(0, 0x80000000, 0, 0x80000000));
+    int j;
+
+    for (j = 0; j < 2 * n4; j += 4) {
+        __m128 a0 = _mm_loadu_ps(p0 + j);
+        __m128 a1 = _mm_loadu_ps(p1 + j);
+        __m128 a2 = _mm_loadu_ps(p2 + j);
+        __m128 a3 = _mm_loadu_ps(p3 + j);
+        __m128 t1 = _mm_loadu_ps((const float*)w1 + j);
+        __m128 t3 = _mm_loadu_ps((const float*)w3 + j);
+        __m128 c, s, sw, sum, dif;
+
+        /*
+            (re * C + im * S, im * C - re * S)
+        */
+        c  = _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(2, 2, 0, 0));
+        s  = _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(3, 3, 1, 1));
+        sw = _mm_shuffle_ps(a2, a2, _MM_SHUFFLE(2, 3, 0, 1));
+        a2 = _mm_add_ps(_mm_mul_ps(a2, c), _mm_xor_ps(_mm_mul_ps(sw, s), imneg));
+
+        c  = _mm_shuffle_ps(t3, t3, _MM_SHUFFLE(2, 2, 0, 0));
+        s  = _mm_shuffle_ps(t3, t3, _MM_SHUFFLE(3, 3, 1, 1));
+        sw = _mm_shuffle_ps(a3, a3, _MM_SHUFFLE(2, 3, 0, 1));
+        a3 = _mm_add_ps(_mm_mul_ps(a3, c), _mm_xor_ps(_mm_mul_ps(sw, s), imneg));
+
+        sum = _mm_add_ps(a2, a3);
+        dif = _mm_sub_ps(a2, a3);
+        dif = _mm_xor_ps(_mm_shuffle_ps(dif, dif, _MM_SHUFFLE(2, 3, 0, 1)), reneg);
+
+        _mm_storeu_ps(p2 + j, _mm_sub_ps(a0, sum));
+        _mm_storeu_ps(p0 + j, _mm_add_ps(a0, sum));
+        _mm_storeu_ps(p3 + j, _mm_add_ps(a1, dif));
+        _mm_storeu_ps(p1 + j, _mm_sub_ps(a1, dif));
+    }
+}
+
+TARGET("avx")
+void L_block_avx(t_complex *x, const t_complex *w1, const t_complex *w3, const int n4)
+{
+    float *p0 = (float*)(x);
+    float *p1 = (float*)(x + n4);
+    float *p2 = (float*)(x + 2 * n4);
+    float *p3 = (float*)(x + 3 * n4);
+    const __m256 imneg = _mm256_castsi256_ps(_mm256_set_epi32(0x80000000, 0, 0x80000000, 0,
+                                                              0x80000000, 0, 0x80000000, 0));
+    const __m256 reneg = _mm256_castsi256_ps(_mm256_set_epi32(0, 0x80000000, 0, 0x80000000,
+                                                              0, 0x80000000, 0, 0x80000000));
+    int j;
+
+    for (j = 0; j < 2 * n4; j += 8) {
+        __m256 a0 = _mm256_loadu_ps(p0 + j);
+        __m256 a1 = _mm256_loadu_ps(p1 + j);
+        __m256 a2 = _mm256_loadu_ps(p2 + j);
+        __m256 a3 = _mm256_loadu_ps(p3 + j);
+        __m256 t1 = _mm256_loadu_ps((const float*)w1 + j);
+        __m256 t3 = _mm256_loadu_ps((const float*)w3 + j);
+        __m256 sw, sum, dif;
+
+        sw = _mm256_permute_ps(a2, _MM_SHUFFLE(2, 3, 0, 1));
+        a2 = _mm256_add_ps(_mm256_mul_ps(a2, _mm256_moveldup_ps(t1)),
+                           _mm256_xor_ps(_mm256_mul_ps(sw, _mm256_movehdup_ps(t1)), imneg));
+
+        sw = _mm256_permute_ps(a3, _MM_SHUFFLE(2, 3, 0, 1));
+        a3 = _mm256_add_ps(_mm256_mul_ps(a3, _mm256_moveldup_ps(t3)),
+                           _mm256_xor_ps(_mm256_mul_ps(sw, _mm256_movehdup_ps(t3)), imneg));
+
+        sum = _mm256_add_ps(a2, a3);
+        dif = _mm256_sub_ps(a2, a3);
+        dif = _mm256_xor_ps(_mm256_permute_ps(dif, _MM_SHUFFLE(2, 3, 0, 1)), reneg);
+
+        _mm256_storeu_ps(p2 + j, _mm256_sub_ps(a0, sum));
+        _mm256_storeu_ps(p0 + j, _mm256_add_ps(a0, sum));
+        _mm256_storeu_ps(p3 + j, _mm256_add_ps(a1, dif));
+        _mm256_storeu_ps(p1 + j, _mm256_sub_ps(a1, dif));
+    }
+}
+
+TARGET("avx512f")
+void L_block_avx512(t_complex *x, const t_complex *w1, const t_complex *w3, const int n4)
+{
+    float *p0 = (float*)(x);
+    float *p1 = (float*)(x + n4);
+    float *p2 = (float*)(x + 2 * n4);
+    float *p3 = (float*)(x + 3 * n4);
+    const __m512i imneg = _mm512_set4_epi32(0x80000000, 0, 0x80000000, 0);
+    const __m512i reneg = _mm512_set4_epi32(0, 0x80000000, 0, 0x80000000);
+    int j;
+
+    for (j = 0; j < 2 * n4; j += 16) {
+        __m512 a0 = _mm512_loadu_ps(p0 + j);
+        __m512 a1 = _mm512_loadu_ps(p1 + j);
+        __m512 a2 = _mm512_loadu_ps(p2 + j);
+        __m512 a3 = _mm512_loadu_ps(p3 + j);
+        __m512 t1 = _mm512_loadu_ps((const float*)w1 + j);
+        __m512 t3 = _mm512_loadu_ps((const float*)w3 + j);
+        __m512 sw, sum, dif;
+
+        sw = _mm512_mul_ps(_mm512_permute_ps(a2, _MM_SHUFFLE(2, 3, 0, 1)), _mm512_movehdup_ps(t1));
+        sw = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(sw), imneg));
+        a2 = _mm512_add_ps(_mm512_mul_ps(a2, _mm512_moveldup_ps(t1)), sw);
+
+        sw = _mm512_mul_ps(_mm512_permute_ps(a3, _MM_SHUFFLE(2, 3, 0, 1)), _mm512_movehdup_ps(t3));
+        sw = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(sw), imneg));
+        a3 = _mm512_add_ps(_mm512_mul_ps(a3, _mm512_moveldup_ps(t3)), sw);
+
+        sum = _mm512_add_ps(a2, a3);
+        dif = _mm512_sub_ps(a2, a3);
+        dif = _mm512_permute_ps(dif, _MM_SHUFFLE(2, 3, 0, 1));
+        dif = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(dif), reneg));
+
+        _mm512_storeu_ps(p2 + j, _mm512_sub_ps(a0, sum));
+        _mm512_storeu_ps(p0 + j, _mm512_add_ps(a0, sum));
+        _mm512_storeu_ps(p3 + j, _mm512_add_ps(a1, dif));
+        _mm512_storeu_ps(p1 + j, _mm512_sub_ps(a1, dif));
+    }
+}
+
+#else
+
+int fft_simd_level(void)
+{
+    return FFT_SCALAR;
+}
+
+#endif
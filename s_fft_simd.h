@@ -0,0 +1,51 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef S_FFT_SIMD_H
+#define S_FFT_SIMD_H
+
+#include "s_fft.h"
+
+/*
+    instruction set levels
+*/
+#define FFT_SCALAR      0
+#define FFT_SSE2        1
+#define FFT_AVX         2
+#define FFT_AVX512      3
+
+/*
+    vector kernels are only built for x86
+    and can be disabled with NO_SIMD
+*/
+#if !defined(NO_SIMD) && (defined(__x86_64__) || defined(__i386__) \
+                          || defined(_M_X64) || defined(_M_IX86))
+#define FFT_X86
+#endif
+
+/*
+    funcs
+*/
+int fft_simd_level(void);
+
+void radix_2_step_sse2(const t_fft_data *tb, t_complex *x);
+
+void L_block1_sse2(t_complex *x);
+void L_block_sse2(t_complex *x, const t_complex *w1, const t_complex *w3, const int n4);
+void L_block_avx(t_complex *x, const t_complex *w1, const t_complex *w3, const int n4);
+void L_block_avx512(t_complex *x, const t_complex *w1, const t_complex *w3, const int n4);
+
+#endif
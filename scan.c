@@ -0,0 +1,154 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+
+/*
+    Scoring one fingerprint against an array of them.
+
+    Only the spectral fits are scored, with the kernels
+    of fp_compare. The array is streamed through once,
+    with the fits of the fingerprints a few places ahead
+    prefetched, as the time per fingerprint is close to
+    the time it takes to bring it in from memory.
+
+    For the best k, a heap keeps the k best so far, and
+    a fingerprint is dropped as soon as its distance
+    passes that of the worst of them.
+*/
+
+#include "common.h"
+#include "compare.h"
+
+/*
+    how many fingerprints ahead to prefetch
+*/
+#define AHEAD           8
+
+/*
+    bring in the fits of the fingerprint at fp
+*/
+static void prefetch_r(const unsigned char *fp)
+{
+    const unsigned char *r = fp + FP_R_OFFSET;
+    int i;
+
+    for (i = 0; i < FP_R_BYTES; i += CACHE_LINE) {
+        PREFETCH(r + i);
+    }
+    PREFETCH(r + FP_R_BYTES - 1);
+}
+
+static int check_args(const unsigned char *query, const unsigned char *base,
+                      const int count, int *stride)
+{
+    if (*stride == 0) {
+        *stride = FPSIZE;
+    }
+
+    if (query == NULL || count < 0 || (count > 0 && base == NULL)
+        || *stride < FP_R_OFFSET + FP_R_BYTES) {
+        return -1;
+    }
+
+    return 0;
+}
+
+FOOIDAPI int fp_scan(const unsigned char *query, const unsigned char *base,
+                     int count, int stride, int *scores)
+{
+    const unsigned char *fp;
+    int level;
+    int i;
+
+    if (check_args(query, base, count, &stride) < 0 || (count > 0 && scores == NULL)) {
+        return -1;
+    }
+
+    level = compare_simd_level();
+
+    for (i = 0; i < count && i < AHEAD; i++) {
+        prefetch_r(base + (size_t)i * stride);
+    }
+
+    for (i = 0, fp = base; i < count; i++, fp += stride) {
+        if (i + AHEAD < count) {
+            prefetch_r(fp + (size_t)AHEAD * stride);
+        }
+
+        scores[i] = r_distance_bound(query + FP_R_OFFSET, fp + FP_R_OFFSET,
+                                     FP_R_BYTES, level, R_MAX + 1);
+    }
+
+    return 0;
+}
+
+FOOIDAPI int fp_scan_topk(const unsigned char *query, const unsigned char *base,
+                          int count, int stride, int k, int *ids, int *scores)
+{
+    const unsigned char *fp;
+    int level;
+    int found = 0;
+    int score;
+    int i;
+
+    if (check_args(query, base, count, &stride) < 0 || k < 0
+        || (k > 0 && (ids == NULL || scores == NULL))) {
+        return -1;
+    }
+
+    if (k == 0) {
+        return 0;
+    }
+
+    level = compare_simd_level();
+
+    for (i = 0; i < count && i < AHEAD; i++) {
+        prefetch_r(base + (size_t)i * stride);
+    }
+
+    /*
+        a max-heap, with the worst of the best at the top
+    */
+    for (i = 0, fp = base; i < count; i++, fp += stride) {
+        if (i + AHEAD < count) {
+            prefetch_r(fp + (size_t)AHEAD * stride);
+        }
+
+        if (found < k) {
+            scores[found] = r_distance_bound(query + FP_R_OFFSET, fp + FP_R_OFFSET,
+                                             FP_R_BYTES, level, R_MAX + 1);
+            ids[found] = i;
+            sift_up(ids, scores, found);
+            found++;
+        } else {
+            score = r_distance_bound(query + FP_R_OFFSET, fp + FP_R_OFFSET,
+                                     FP_R_BYTES, level, scores[0]);
+
+            if (score < scores[0]) {
+                scores[0] = score;
+                ids[0] = i;
+                sift_down(ids, scores, found, 0);
+            }
+        }
+    }
+
+    /*
+        sort, best first
+    */
+    heap_sort(ids, scores, found);
+
+    return found;
+}
@@ -22,8 +22,17 @@
 #include "common.h"
 #include "s_fft.h"
 #include "spectrum.h"
+#include "thread.h"
 #include "harmonics.h"
 #include "regress.h"
+#include "fastlog.h"
+
+/*
+    analysis tables, built on first use
+*/
+static t_mutex tables_lock = MUTEX_INITIALIZER;
+static t_frame_tables frame_tables;
+static int tables_ready = FALSE;
 
 /*
     transform frequency to Bark
@@ -46,27 +55,12 @@ static const float toBARK(const float f)
 /*
     make a Hann window for the FFT
 */
-void init_sine_window(t_fooid *fi)
+static void init_sine_window(t_frame_tables *ft)
 {
     int i;
 
     for (i = 0; i < SPEC_LEN; i++) {
-        fi->window[i] = (float)sqrt(0.5 - 0.5*cos(2*PI*(float)i/(FRAME_LEN)));
-    }
-}
-
-/*
-    apply a window function to float data
-*/
-static void windowize(float *window, float *smp)
-{
-    int i;
-
-    for(i = 0; i < SPEC_LEN; i++) {
-        smp[i] *= window[i];
-    }
-    for(i = SPEC_LEN; i < FRAME_LEN; i++) {
-        smp[i] *= window[FRAME_LEN - i - 1];
+        ft->window[i] = (float)sqrt(0.5 - 0.5*cos(2*PI*(float)i/(FRAME_LEN)));
     }
 }
 
@@ -74,7 +68,7 @@ static void windowize(float *window, float *smp)
     set lookups from frequency or spectrum line
     to Bark and the reverse
 */
-void init_scales(t_fooid *fi)
+static void init_scales(t_frame_tables *ft)
 {
     int i;
     float f;
@@ -82,7 +76,7 @@ void init_scales(t_fooid *fi)
     int cbsize;
     int cb;
 
-    fi->cb_start[0] = 0;
+    ft->cb_start[0] = 0;
     cbsize = 0;
     lastcb = 0;
 
@@ -101,11 +95,9 @@ void init_scales(t_fooid *fi)
             cb = MAX_BARK - 1;
         }
 
-        fi->line_to_cb[i] = cb;
-
         if (cb != lastcb) {
-            fi->cb_start[lastcb + 1] = i;
-            fi->cb_size[lastcb] = cbsize;
+            ft->cb_start[lastcb + 1] = i;
+            ft->cb_size[lastcb] = cbsize;
             lastcb++;
             cbsize = 0;
         }
@@ -113,18 +105,50 @@ void init_scales(t_fooid *fi)
         cbsize++;
     }
 
-    fi->cb_size[lastcb] = cbsize;
-    fi->max_sfb = lastcb + 1;
+    ft->cb_size[lastcb] = cbsize;
+    ft->max_sfb = lastcb + 1;
+}
+
+/*
+    get the window and Bark scales,
+    shared by every handle
+*/
+const t_frame_tables* get_frame_tables(void)
+{
+    mutex_lock(&tables_lock);
+    if (!tables_ready) {
+        init_sine_window(&frame_tables);
+        init_scales(&frame_tables);
+        init_band_regress(&frame_tables);
+        init_dom_codes(frame_tables.dom_code);
+        tables_ready = TRUE;
+    }
+    mutex_unlock(&tables_lock);
+
+    return &frame_tables;
 }
 
-static void get_dbpower(t_complex *work, float *dbpower)
+/*
+    get the power spectrum in dB, and in the same pass
+    the spectral line with the most power
+
+    output * index of the strongest line
+*/
+static int get_dbpower(const t_complex *work, float *dbpower)
 {
     int i;
     float power;
+    float maxpower = 0.0f;
+    int maxid = 0;
 
     for (i = 0; i < SPEC_LEN; i++) {
         power = (work[i].re * work[i].re) + (work[i].im * work[i].im);
 
+        if (power > maxpower) {
+            maxpower = power;
+            maxid = i;
+        }
+
         if (power <= EPSILON) {
             dbpower[i] = 0.0f;
         } else {
@@ -132,9 +156,16 @@ static void get_dbpower(t_complex *work, float *dbpower)
             dbpower[i] = (float)log(power) * 4.34294480f;
         }
     }
+
+    return maxid;
 }
 
-static int quantize_r(const float r, const int band)
+/*
+    quantize the fits of bands 1 to max_sfb - 1,
+    the borders go up in every band, so the code
+    is the number of borders at or below the fit
+*/
+static void quantize_r(const float *rf, int *qr, const int max_sfb)
 {
     const static float q1[MAX_BARK] = {
         0.8116f,
@@ -159,29 +190,283 @@ static int quantize_r(const float r, const int band)
         0.4674f,        0.4612f,        0.4929f,        0.6746f
     };
 
-    if (r < q1[band]) {
-        return 0;
+    int j;
+
+    for (j = 1; j < max_sfb; j++) {
+        qr[j] = 3 - (rf[j] < q1[j]) - (rf[j] < q2[j]) - (rf[j] < q3[j]);
+    }
+}
+
+/*
+    silence, used for frames we never got data for
+*/
+static const float zero_frame[FRAME_LEN];
+
+/*
+    analyse the spectrum of a frame in work, store its
+    spectral fits in r (4 bytes), add them to counts
+    and return the dominant harmonic
+*/
+static int spectrum_params(const t_fooid *fi, const t_complex *work,
+                           unsigned char *r, int *counts)
+{
+    const t_frame_tables *ft = fi->tables;
+    const t_fft_data *fft_data = fi->fft_data;
+    int j;
+    float rf[MAX_BARK];
+    int qr[MAX_BARK];
+    float dbpower[SPEC_LEN];
+    int maxid;
+    int idom;
+
+#if defined(FOOID_EXACT_LOG)
+    maxid = get_dbpower(work, dbpower);
+#else
+    if (fi->exact_log) {
+        maxid = get_dbpower(work, dbpower);
+    } else {
+        maxid = get_dbpower_fast(work, dbpower, SPEC_LEN, fft_data->simd);
+    }
+#endif
+
+    band_regress(ft, dbpower, rf);
+    quantize_r(rf, qr, ft->max_sfb);
+
+    idom = ft->dom_code[maxid];
+
+    for (j = 1; j < ft->max_sfb; j++) {
+        counts[qr[j]]++;
+    }
+
+    /*
+        store the r data packed into bytes, 4 bytes per frame
+    */
+    r[0]  = (qr[1] << 6)  | (qr[2] << 4)  | (qr[3] << 2)  | qr[4];
+    r[1]  = (qr[5] << 6)  | (qr[6] << 4)  | (qr[7] << 2)  | qr[8];
+    r[2]  = (qr[9] << 6)  | (qr[10] << 4) | (qr[11] << 2) | qr[12];
+    r[3]  = (qr[13] << 6) | (qr[14] << 4) | (qr[15] << 2) | qr[16];
+
+    return idom;
+}
+
+/*
+    analyse one frame of samples, as above
+
+    only work is written to besides the outputs,
+    so frames can be analysed at the same time
+    with a work buffer each
+*/
+static int frame_params(const t_fooid *fi, t_complex *work, const float *smp,
+                        unsigned char *r, int *counts)
+{
+    const t_frame_tables *ft = fi->tables;
+    int j;
+
+    /*
+        set up FFT data, windowed
+        the samples themselves are left alone
+    */
+    for (j = 0; j < SPEC_LEN / 2; j++) {
+        work[j].re = smp[2 * j]     * ft->window[2 * j];
+        work[j].im = smp[2 * j + 1] * ft->window[2 * j + 1];
     }
-    if (r < q2[band]) {
-        return 1;
+    for (j = SPEC_LEN / 2; j < SPEC_LEN; j++) {
+        work[j].re = smp[2 * j]     * ft->window[FRAME_LEN - 2 * j - 1];
+        work[j].im = smp[2 * j + 1] * ft->window[FRAME_LEN - 2 * j - 2];
     }
-    if (r < q3[band]) {
-        return 2;
+
+    rfft(fi->fft_data, work);
+
+    return spectrum_params(fi, work, r, counts);
+}
+
+/*
+    analyse the frame that was just completed
+    in fi->samples, or keep it for later when
+    analysing in parallel
+*/
+void analyse_frame(t_fooid *fi)
+{
+    int idom;
+
+    assert(fi->frames < ANFRAMES);
+
+    if (fi->frame_store != NULL) {
+        memcpy(&(fi->frame_store[fi->frames * FRAME_LEN]), fi->samples,
+               sizeof(float) * FRAME_LEN);
+        fi->frames++;
+        return;
     }
 
-    return 3;
+    idom = frame_params(fi, fi->fft_work, fi->samples, &(fi->fp.r[fi->frames * 4]), fi->counts);
+
+    fi->total_dom += idom;
+    fi->doms[fi->frames] = idom;
+    fi->frames++;
+    fi->analysed++;
+}
+
+/*
+    a share of the kept frames, for one task
+*/
+typedef struct
+{
+    t_fooid *fi;
+    int first;
+    int count;
+    int tasks;
+    int (*counts)[4];
 }
+t_frame_batch;
 
+static void analyse_part(void *arg, int index)
+{
+    t_frame_batch *batch = (t_frame_batch *)arg;
+    t_fooid *fi = batch->fi;
+    t_complex *work = &(fi->thread_work[index * SPEC_LEN]);
+    int from = batch->first + (batch->count * index) / batch->tasks;
+    int to   = batch->first + (batch->count * (index + 1)) / batch->tasks;
+    int i;
+
+    for (i = from; i < to; i++) {
+        memset(batch->counts[i], 0, sizeof(int) * 4);
+        fi->doms[i] = frame_params(fi, work, &(fi->frame_store[i * FRAME_LEN]),
+                                   &(fi->fp.r[i * 4]), batch->counts[i]);
+    }
+}
+
+typedef struct
+{
+    fp_task_func task;
+    void *arg;
+    int first;
+    int step;
+    int count;
+}
+t_task_call;
+
+/*
+    run every step-th task from the first one
+*/
+static void run_calls(const t_task_call *call)
+{
+    int i;
+
+    for (i = call->first; i < call->count; i += call->step) {
+        call->task(call->arg, i);
+    }
+}
+
+static THREAD_PROC(task_thread, arg)
+{
+    run_calls((t_task_call *)arg);
+
+    THREAD_RETURN;
+}
+
+/*
+    run the tasks on threads of our own, no more
+    than there are cores, each taking every so
+    many tasks; the first share runs on the
+    calling thread, and any we can't start a
+    thread for there as well
+*/
+static void run_threads(fp_task_func task, void *arg, int count)
+{
+    t_thread threads[ANFRAMES];
+    t_task_call calls[ANFRAMES];
+    int started[ANFRAMES];
+    int workers;
+    int i;
+
+    workers = thread_cores();
+    if (workers > count) {
+        workers = count;
+    }
+    if (workers < 1) {
+        workers = 1;
+    }
+
+    for (i = 0; i < workers; i++) {
+        calls[i].task = task;
+        calls[i].arg = arg;
+        calls[i].first = i;
+        calls[i].step = workers;
+        calls[i].count = count;
+    }
+
+    for (i = 1; i < workers; i++) {
+        started[i] = thread_start(&threads[i], task_thread, &calls[i]);
+    }
+
+    run_calls(&calls[0]);
+
+    for (i = 1; i < workers; i++) {
+        if (started[i]) {
+            thread_join(threads[i]);
+        } else {
+            run_calls(&calls[i]);
+        }
+    }
+}
+
+/*
+    analyse the frames kept since the last call,
+    split over the tasks, and add up their results
+    in frame order
+*/
+static void analyse_kept(t_fooid *fi)
+{
+    t_frame_batch batch;
+    int counts[ANFRAMES][4];
+    int tasks;
+    int i, j;
+
+    if (fi->analysed >= fi->frames) {
+        return;
+    }
+
+    batch.fi = fi;
+    batch.first = fi->analysed;
+    batch.count = fi->frames - fi->analysed;
+    batch.counts = counts;
+
+    tasks = fi->threads;
+    if (tasks > batch.count) {
+        tasks = batch.count;
+    }
+    batch.tasks = tasks;
+
+    if (fi->executor != NULL) {
+        fi->executor(fi->executor_ctx, analyse_part, &batch, tasks);
+    } else {
+        run_threads(analyse_part, &batch, tasks);
+    }
+
+    for (i = batch.first; i < fi->frames; i++) {
+        for (j = 0; j < 4; j++) {
+            fi->counts[j] += counts[i][j];
+        }
+        fi->total_dom += fi->doms[i];
+    }
+
+    fi->analysed = fi->frames;
+}
+
+/*
+    finish the fingerprint: analyse whatever is left
+    of the analysis window and pack the results
+
+    the per frame results in fi are not changed, so
+    this can be called again after feeding more data
+*/
 void get_params(t_fooid *fi)
 {
-    t_fft_data *fft_data;
     int i, j;
     int frames;
-    int ansize;
-    float r[MAX_BARK];
-    int qr[MAX_BARK];
-    float dbpower[SPEC_LEN];
     int counts[4];
+    int zcounts[4];
+    unsigned char zr[4];
     int doms[88];
     int domidx;
     int idom;
@@ -189,61 +474,44 @@ void get_params(t_fooid *fi)
     float avg_dom;
     float avg_qr;
 
-    /*
-        prepare FFT data and window
-    */
-    fft_data = fft_init(FRAME_LEN);
+    frames = ANFRAMES;
 
-    ansize = (8000 * 90);
+    analyse_kept(fi);
 
-    frames = ansize / FRAME_LEN;
+    memcpy(counts, fi->counts, sizeof(int) * 4);
+    memcpy(doms, fi->doms, sizeof(int) * 88);
+    total_dom = fi->total_dom;
 
-    counts[0] = 0;
-    counts[1] = 0;
-    counts[2] = 0;
-    counts[3] = 0;
-    total_dom = 0;
-    memset(doms, 0, sizeof(int) * 88);
+    i = fi->frames;
 
-    for (i = 0; i < frames; i++) {
-        /*
-            set up FFT data
-        */
-        windowize(fi->window, &(fi->samples[i * FRAME_LEN]));
-
-        for (j = 0; j < FRAME_LEN; j++) {
-            fft_data->work[j].re = fi->samples[i * FRAME_LEN + j];
-            fft_data->work[j].im = 0.0f;
-        }
-
-        fft(fft_data, fft_data->work);
-
-        get_dbpower(fft_data->work, dbpower);
-
-        for (j = 1; j < fi->max_sfb; j++) {
-            do_linear_regress(&dbpower[fi->cb_start[j]], fi->cb_size[j], &r[j]);
-            qr[j] = quantize_r(r[j], j);
-        }
-
-        get_dominant_harmonic(fft_data->work, &idom);
+    /*
+        the frame we were filling, padded with silence
+    */
+    if (i < frames) {
+        memset(&(fi->samples[fi->framepos]), 0, sizeof(float) * (FRAME_LEN - fi->framepos));
 
+        idom = frame_params(fi, fi->fft_work, fi->samples, &(fi->fp.r[i * 4]), counts);
         total_dom += idom;
+        doms[i] = idom;
+        i++;
+    }
 
-        for (j = 1; j < fi->max_sfb; j++) {
-            counts[qr[j]]++;
+    /*
+        everything after that is silence,
+        which always gives the same result
+    */
+    if (i < frames) {
+        memset(zcounts, 0, sizeof(int) * 4);
+        idom = frame_params(fi, fi->fft_work, zero_frame, zr, zcounts);
+
+        for (; i < frames; i++) {
+            memcpy(&(fi->fp.r[i * 4]), zr, 4);
+            for (j = 0; j < 4; j++) {
+                counts[j] += zcounts[j];
+            }
+            total_dom += idom;
+            doms[i] = idom;
         }
-
-        /*
-            store the r data packed into bytes, 4 bytes per frame
-        */
-        fi->fp.r[(i*4)]    = (qr[1] << 6)  | (qr[2] << 4)  | (qr[3] << 2)  | qr[4];
-        fi->fp.r[(i*4)+1]  = (qr[5] << 6)  | (qr[6] << 4)  | (qr[7] << 2)  | qr[8];
-        fi->fp.r[(i*4)+2]  = (qr[9] << 6)  | (qr[10] << 4) | (qr[11] << 2) | qr[12];
-        fi->fp.r[(i*4)+3]  = (qr[13] << 6) | (qr[14] << 4) | (qr[15] << 2) | qr[16];
-        /*
-            store the dom data in a temporary array
-        */
-        doms[i]   = idom;
     }
 
     /*
@@ -260,10 +528,8 @@ void get_params(t_fooid *fi)
 
     avg_dom = (float)total_dom / (float)frames;
     avg_qr  = ((1.0f * counts[1]) + (2.0f * counts[2]) + (3.0f * counts[3]))
-              / ((float)frames*(float)(fi->max_sfb-1));
+              / ((float)frames*(float)(fi->tables->max_sfb-1));
 
     fi->fp.avg_dom = round(avg_dom *  100.0f);
     fi->fp.avg_fit = round(avg_qr  * 1000.0f);
-
-    fft_free(fft_data);
 }
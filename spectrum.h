@@ -19,8 +19,8 @@
 
 #include "common.h"
 
+void analyse_frame(t_fooid *fi);
 void get_params(t_fooid *fi);
-void init_sine_window(t_fooid *fi);
-void init_scales(t_fooid *fi);
+const t_frame_tables* get_frame_tables(void);
 
 #endif
@@ -0,0 +1,67 @@
+/*
+    libFooID - Free audio fingerprinting library
+    Copyright (C) 2006 Gian-Carlo Pascutto, Hogeschool Gent
+
+    Use of this software is allowed under either:
+
+    1) The GNU General Public License (GPL), as described
+       in LICENSE.GPL.
+
+    2) A modified BSD License, as described in LICENSE.BSDA.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+#ifndef THREAD_H
+#define THREAD_H
+
+/*
+    minimal portability layer for the few places
+    that need to synchronize between threads
+    or start them
+
+    thread_start gives TRUE on success, and
+    thread_cores the number of processor cores
+*/
+#if defined(_WIN32)
+#include <windows.h>
+
+typedef SRWLOCK t_mutex;
+
+#define MUTEX_INITIALIZER   SRWLOCK_INIT
+#define mutex_init(m)       InitializeSRWLock(m)
+#define mutex_destroy(m)
+#define mutex_lock(m)       AcquireSRWLockExclusive(m)
+#define mutex_unlock(m)     ReleaseSRWLockExclusive(m)
+
+typedef HANDLE t_thread;
+
+#define THREAD_PROC(name, arg)  DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN           return 0
+#define thread_start(t, f, arg) ((*(t) = CreateThread(NULL, 0, (f), (arg), 0, NULL)) != NULL)
+#define thread_join(t)          (WaitForSingleObject((t), INFINITE), CloseHandle(t))
+#define thread_cores()          ((int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS))
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_mutex_t t_mutex;
+
+#define MUTEX_INITIALIZER   PTHREAD_MUTEX_INITIALIZER
+#define mutex_init(m)       pthread_mutex_init((m), NULL)
+#define mutex_destroy(m)    pthread_mutex_destroy(m)
+#define mutex_lock(m)       pthread_mutex_lock(m)
+#define mutex_unlock(m)     pthread_mutex_unlock(m)
+
+typedef pthread_t t_thread;
+
+#define THREAD_PROC(name, arg)  void* name(void *arg)
+#define THREAD_RETURN           return NULL
+#define thread_start(t, f, arg) (pthread_create((t), NULL, (f), (arg)) == 0)
+#define thread_join(t)          pthread_join((t), NULL)
+#define thread_cores()          ((int)sysconf(_SC_NPROCESSORS_ONLN))
+#endif
+
+#endif
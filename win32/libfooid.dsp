@@ -85,10 +85,26 @@ LIB32=xilink6.exe -lib
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=..\batch.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\common.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\compare.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\downmix.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\fastlog.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\fooid.c
 # End Source File
 # Begin Source File
@@ -97,6 +113,14 @@ SOURCE=..\harmonics.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\index.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\polyphase.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\regress.c
 # End Source File
 # Begin Source File
@@ -105,6 +129,14 @@ SOURCE=..\s_fft.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\s_fft_simd.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\scan.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\spectrum.c
 # End Source File
 # End Group
@@ -117,6 +149,18 @@ SOURCE=..\common.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\compare.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\downmix.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\fastlog.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\fooid.h
 # End Source File
 # Begin Source File
@@ -125,6 +169,14 @@ SOURCE=..\harmonics.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\polyphase.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\prefix.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\regress.h
 # End Source File
 # Begin Source File
@@ -133,8 +185,16 @@ SOURCE=..\s_fft.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\s_fft_simd.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\spectrum.h
 # End Source File
+# Begin Source File
+
+SOURCE=..\thread.h
+# End Source File
 # End Group
 # End Target
 # End Project